@@ -25,6 +25,7 @@ namespace Sse {
         Vec4f operator&(const Vec4f r) const noexcept { return Vec4f{_mm_and_ps(_vec, r._vec)}; } // NOLINT
         Vec4f operator|(const Vec4f r) const noexcept { return Vec4f{_mm_or_ps(_vec, r._vec)}; } // NOLINT
         Vec4f operator^(const Vec4f r) const noexcept { return Vec4f{_mm_xor_ps(_vec, r._vec)}; } // NOLINT
+        [[nodiscard]] Vec4f andNot(const Vec4f r) const noexcept { return Vec4f{_mm_andnot_ps(r._vec, _vec)}; } // NOLINT
         // special relational operators
         Vec4f operator<(const Vec4f r) const noexcept { return Vec4f(_mm_cmplt_ps(_vec, r._vec)); }
 
@@ -85,6 +86,12 @@ namespace Sse {
 
         [[nodiscard]] int sign_bits() const noexcept { return _mm_movemask_ps(_vec); }
 
+        void store(float *dst) const noexcept { _mm_storeu_ps(dst, _vec); }
+
+        [[nodiscard]] __m128 m128() const noexcept { return _vec; }
+
+        static Vec4f load(const float *src) noexcept { return Vec4f(_mm_loadu_ps(src)); }
+
         [[nodiscard]] Vec4f xyzw() const noexcept { return shuffle<3, 2, 1, 0>(); }
 
         static Vec4f nan() noexcept { return Vec4f(_mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF))); }
@@ -97,6 +104,15 @@ namespace Sse {
 
     inline Vec4f fma(const Vec4f a, const Vec4f b, const Vec4f c) noexcept { return a * b + c; }
 
+    // all bits set in lane i when bit i of bits is set
+    inline Vec4f laneMask(const int bits) noexcept {
+        return Vec4f(_mm_castsi128_ps(_mm_set_epi32(-((bits >> 3) & 1), -((bits >> 2) & 1),
+                                                    -((bits >> 1) & 1), -(bits & 1))));
+    }
+
+    // a where mask lanes are set, b elsewhere
+    inline Vec4f select(const Vec4f mask, const Vec4f a, const Vec4f b) noexcept { return (a & mask) | b.andNot(mask); }
+
     inline Vec4f sign(const Vec4f x) noexcept {
         auto const zro0 = Vec4f(0.0f);
         return ((x < zro0) & Vec4f(-1.0f)) | ((x > zro0) & Vec4f(1.0f));
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include "arena.h"
+
+Arena::Arena(size_t defaultBlockSize) {
+    first = NULL;
+    current = NULL;
+    blockNum = 0;
+    blockSize = defaultBlockSize;
+    offset = 0;
+    used = 0;
+    lastPeak = 0;
+    maxPeak = 0;
+}
+
+Arena::~Arena() {
+    while (first != NULL) {
+        Block *next = first->next;
+        delete[] first->data;
+        delete first;
+        first = next;
+    }
+}
+
+// move on to a block holding at least size bytes, blocks too small are skipped this frame
+void Arena::nextBlock(size_t size) {
+    Block *prev = current;
+    Block *block = current != NULL ? current->next : first;
+    while (block != NULL && block->size < size) {
+        prev = block;
+        block = block->next;
+    }
+    if (block == NULL) {
+        block = new Block;
+        block->size = size > blockSize ? size : blockSize;
+        block->data = new unsigned char[block->size];
+        block->next = NULL;
+        if (prev != NULL)
+            prev->next = block;
+        else
+            first = block;
+        blockNum++;
+    }
+    current = block;
+    offset = 0;
+}
+
+void *Arena::alloc(size_t size, size_t align) {
+    if (current == NULL)
+        nextBlock(size + align);
+    uintptr_t base = (uintptr_t) current->data;
+    size_t start = ((base + offset + align - 1) & ~(uintptr_t) (align - 1)) - base;
+    if (start + size > current->size) {
+        nextBlock(size + align);
+        base = (uintptr_t) current->data;
+        start = ((base + align - 1) & ~(uintptr_t) (align - 1)) - base;
+    }
+    used += start - offset + size;
+    offset = start + size;
+    return current->data + start;
+}
+
+void Arena::reset() {
+    lastPeak = used;
+    if (used > maxPeak)
+        maxPeak = used;
+    current = NULL;
+    offset = 0;
+    used = 0;
+}
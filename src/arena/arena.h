@@ -0,0 +1,58 @@
+#ifndef ARENA_H_
+#define ARENA_H_
+
+#include <stddef.h>
+#include <new>
+#include <type_traits>
+
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+// Bump allocator for data that lives until the end of a frame. Blocks are
+// kept across frames, reset() only rewinds to the first one and runs no
+// destructors, so only trivially destructible types may be created.
+// Every render thread owns its own arena (see frameArena).
+class Arena {
+private:
+    struct Block {
+        unsigned char *data;
+        size_t size;
+        Block *next;
+    };
+
+    Block *first, *current;
+    int blockNum;
+    size_t blockSize;
+    size_t offset;
+    size_t used;
+
+    void nextBlock(size_t size);
+
+public:
+    size_t lastPeak, maxPeak; //bytes handed out in the last frame and in the worst frame
+
+    Arena(size_t defaultBlockSize = ARENA_BLOCK_SIZE);
+
+    ~Arena();
+
+    void *alloc(size_t size, size_t align);
+
+    template<typename T, typename... Args>
+    T *create(const Args &... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new(alloc(sizeof(T), alignof(T))) T(args...);
+    }
+
+    template<typename T>
+    T *createArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        return new(alloc(sizeof(T) * count, alignof(T))) T[count];
+    }
+
+    void reset();
+
+    size_t getUsed() const { return used; }
+
+    int getBlockNum() const { return blockNum; }
+};
+
+#endif /* ARENA_H_ */
@@ -0,0 +1,176 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame.h"
+#include "texture/BmpLoader.h"
+
+// Offline renderer for camera paths. Every worker thread owns a complete
+// render state (see RENDER_LOCAL) and renders whole frames, finished
+// images are handed to a single writer thread.
+
+struct PathKey {
+    float x, y, z, xrot, yrot;
+};
+
+struct FrameImage {
+    int index;
+    std::vector<unsigned char> bgra;
+};
+
+class FrameWriter {
+private:
+    std::deque<FrameImage> queue;
+    std::mutex mutex;
+    std::condition_variable notEmpty, notFull;
+    size_t capacity;
+    bool finished;
+    std::string pattern;
+    int width, height;
+    std::thread thread;
+
+    void run() {
+        for (;;) {
+            FrameImage image;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                notEmpty.wait(lock, [this] { return finished || !queue.empty(); });
+                if (queue.empty())
+                    return;
+                image = std::move(queue.front());
+                queue.pop_front();
+            }
+            notFull.notify_one();
+            char fileName[1024];
+            snprintf(fileName, sizeof(fileName), pattern.c_str(), image.index);
+            saveBitmap(fileName, image.bgra.data(), width, height, 4);
+        }
+    }
+
+public:
+    FrameWriter(const std::string &filePattern, int w, int h, size_t maxQueued) :
+            capacity(maxQueued), finished(false), pattern(filePattern), width(w), height(h) {
+        thread = std::thread(&FrameWriter::run, this);
+    }
+
+    void push(FrameImage &&image) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notFull.wait(lock, [this] { return queue.size() < capacity; });
+            queue.push_back(std::move(image));
+        }
+        notEmpty.notify_one();
+    }
+
+    void finish() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        notEmpty.notify_all();
+        thread.join();
+    }
+};
+
+bool loadPath(const char *fileName, std::vector<PathKey> &path) {
+    std::ifstream file(fileName);
+    if (!file) {
+        std::cout << "Path " << fileName << " could not be opened" << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream values(line);
+        PathKey key;
+        if (values >> key.x >> key.y >> key.z >> key.xrot >> key.yrot)
+            path.push_back(key);
+    }
+    return true;
+}
+
+void renderWorker(const std::vector<PathKey> &path, std::atomic<int> &next,
+                  int width, int height, FrameWriter &writer) {
+    init();
+    resize(width, height);
+    for (;;) {
+        int index = next.fetch_add(1);
+        if (index >= (int) path.size())
+            break;
+        const PathKey &key = path[index];
+        placeSight(key.x, key.y, key.z, key.xrot, key.yrot);
+        draw();
+
+        // draw() renders into the front buffer and swaps, the finished frame is the back buffer now
+        FrameImage image;
+        image.index = index;
+        image.bgra.resize(width * height * 4);
+        copyFrameBuffer(backBuffer, image.bgra.data(), width * 4, PIXEL_BGRA8);
+        writer.push(std::move(image));
+    }
+    release();
+}
+
+void printUsage() {
+    std::cout << "usage: RendererBatch --path camera.txt [--width W] [--height H] [--threads N]"
+                 " [--output frame_%05d.bmp]" << std::endl;
+    std::cout << "camera.txt: one frame per line, \"x y z xrot yrot\" of the Sight" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+    int threads = (int) std::thread::hardware_concurrency();
+    const char *pathFile = nullptr;
+    std::string output = "frame_%05d.bmp";
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--path")
+            pathFile = argv[++i];
+        else if (i + 1 < argc && arg == "--width")
+            width = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--height")
+            height = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--threads")
+            threads = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--output")
+            output = argv[++i];
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (pathFile == nullptr || width <= 0 || height <= 0) {
+        printUsage();
+        return 1;
+    }
+    threads = max(threads, 1);
+
+    std::vector<PathKey> path;
+    if (!loadPath(pathFile, path))
+        return 1;
+
+    auto start = std::chrono::steady_clock::now();
+    FrameWriter writer(output, width, height, threads * 2);
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back(renderWorker, std::cref(path), std::ref(next), width, height, std::ref(writer));
+    for (auto &worker : workers)
+        worker.join();
+    writer.finish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << path.size() << " frames at " << width << "x" << height << " on " << threads << " threads in "
+              << elapsed.count() << " s, " << path.size() / elapsed.count() << " fps" << std::endl;
+    return 0;
+}
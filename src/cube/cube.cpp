@@ -2,6 +2,7 @@
 
 Cube::Cube() {
     faceNum = 12;
+    revision = 0;
     initVerts();
 }
 
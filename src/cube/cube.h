@@ -11,11 +11,14 @@ private:
 
 public:
     Vertex *verts;
+    unsigned int revision; //bumped by whoever changes verts in place
 
     Cube();
 
     ~Cube();
 
+    int getFaceNum() const { return faceNum; }
+
     void render(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader fs, int cullFlag);
 };
 
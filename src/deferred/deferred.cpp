@@ -0,0 +1,310 @@
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "deferred.h"
+#include "../shader/shader.h"
+#include "../shadow/shadow.h"
+#include "../graphicLib/rasterVariant.h"
+
+RENDER_LOCAL GBuffer gbuffer = {nullptr, nullptr};
+RENDER_LOCAL bool deferredPass = false;
+RENDER_LOCAL PointLight *pointLights = nullptr;
+RENDER_LOCAL int pointLightNum = 0;
+RENDER_LOCAL int lightingThreads = 0;
+
+// Everything the lighting threads read. The renderer state is thread local,
+// so the uniforms are copied in here by the calling thread.
+struct LightingPass {
+    FrameBuffer *fb;
+    const DepthBuffer *db;
+    GBuffer targets;
+    Mat44 invProject, invViewProject;
+    Mat44 lightMatrix;
+    Vec3 lightDirection;
+    Vec4 ambient, diffuse;
+    Sampler *shadow; //view of the shadow map, shared since its lookups write nothing
+    const PointLight *lights;
+    const Vec3 *viewCenters;
+    int lightNum;
+    int tilesX, tilesY;
+    std::atomic<int> nextTile;
+    std::atomic<long long> evaluations;
+};
+
+void lightTiles(LightingPass *pass);
+
+// Threads kept across frames, each pass wakes them instead of starting new ones.
+class LightingWorkers {
+private:
+    std::mutex mutex;
+    std::condition_variable started, done;
+    std::vector<std::thread> threads;
+    LightingPass *pass;
+    unsigned int generation;
+    int running;
+    bool finished;
+
+    void run() {
+        unsigned int seen = 0;
+        for (;;) {
+            LightingPass *current;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                started.wait(lock, [this, seen] { return finished || generation != seen; });
+                if (finished)
+                    return;
+                seen = generation;
+                current = pass;
+            }
+            lightTiles(current);
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--running == 0)
+                done.notify_one();
+        }
+    }
+
+public:
+    explicit LightingWorkers(int count) : pass(nullptr), generation(0), running(0), finished(false) {
+        for (int i = 0; i < count; i++)
+            threads.emplace_back(&LightingWorkers::run, this);
+    }
+
+    ~LightingWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            finished = true;
+        }
+        started.notify_all();
+        for (auto &thread : threads)
+            thread.join();
+    }
+
+    int size() const { return (int) threads.size(); }
+
+    // lights the pass with the workers and the calling thread, returns when all are done
+    void light(LightingPass *lightingPass) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pass = lightingPass;
+            running = (int) threads.size();
+            generation++;
+        }
+        started.notify_all();
+        lightTiles(lightingPass);
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return running == 0; });
+    }
+};
+
+RENDER_LOCAL LightingWorkers *lightingWorkers = nullptr;
+
+float randomUnit(unsigned int &seed) {
+    seed = seed * 1664525u + 1013904223u;
+    return (float) (seed >> 8) / 16777216.0f;
+}
+
+void initDeferred(int lightNum) {
+    delete[] pointLights;
+    pointLights = new PointLight[lightNum];
+    pointLightNum = lightNum;
+    unsigned int seed = 1;
+    for (int i = 0; i < lightNum; i++) {
+        PointLight &light = pointLights[i];
+        float x = randomUnit(seed) * 24.0f - 12.0f;
+        float y = randomUnit(seed) * 2.0f + 0.3f;
+        float z = randomUnit(seed) * 24.0f - 12.0f;
+        light.position = Vec3(x, y, z);
+        float r = randomUnit(seed), g = randomUnit(seed), b = randomUnit(seed);
+        light.color = Vec3(r, g, b) * 0.8f;
+        light.radius = randomUnit(seed) * 2.0f + 1.5f;
+        light.direction = Vec3(0, -1, 0);
+        // every fourth light is a spot light facing the ground
+        light.cosInner = i % 4 == 3 ? 0.9063f : -1.0f; //25 degrees
+        light.cosOuter = i % 4 == 3 ? 0.7660f : -1.0f; //40 degrees
+    }
+}
+
+void releaseDeferred() {
+    delete lightingWorkers;
+    lightingWorkers = nullptr;
+    delete[] pointLights;
+    pointLights = nullptr;
+    pointLightNum = 0;
+    if (gbuffer.albedo != nullptr)
+        releaseFrameBuffer(&gbuffer.albedo);
+    if (gbuffer.normal != nullptr)
+        releaseFrameBuffer(&gbuffer.normal);
+}
+
+void beginGBuffer(int width, int height) {
+    if (gbuffer.albedo == nullptr) {
+        initFrameBuffer(&gbuffer.albedo, width, height, PIXEL_BGRA8, LAYOUT_LINEAR);
+        initFrameBuffer(&gbuffer.normal, width, height, PIXEL_BGRA8, LAYOUT_LINEAR);
+    } else {
+        resizeFrameBuffer(gbuffer.albedo, width, height, PIXEL_BGRA8, LAYOUT_LINEAR);
+        resizeFrameBuffer(gbuffer.normal, width, height, PIXEL_BGRA8, LAYOUT_LINEAR);
+    }
+    clearScreen(gbuffer.albedo, 0, 0, 0);
+    clearScreen(gbuffer.normal, 0, 0, 0);
+}
+
+// indices of the lights whose sphere touches the view space box, returns their count
+int cullLights(const LightingPass *pass, const Vec3 &boxMin, const Vec3 &boxMax, int *tileLights) {
+    int count = 0;
+    for (int i = 0; i < pass->lightNum; i++) {
+        const Vec3 &c = pass->viewCenters[i];
+        float dx = max(0.0f, max(boxMin.x - c.x, c.x - boxMax.x));
+        float dy = max(0.0f, max(boxMin.y - c.y, c.y - boxMax.y));
+        float dz = max(0.0f, max(boxMin.z - c.z, c.z - boxMax.z));
+        float radius = pass->lights[i].radius;
+        if (dx * dx + dy * dy + dz * dz <= radius * radius)
+            tileLights[count++] = i;
+    }
+    return count;
+}
+
+Vec3 shadePixel(const LightingPass *pass, const Vec4 &world, const Vec3 &normal, const int *tileLights,
+                int tileLightNum) {
+    // the directional light and its shadow as in fragmentShader
+    float nDotL = max(pass->lightDirection.DotProduct(normal), 0.0f);
+    Vec4 lightColor = pass->ambient + pass->diffuse * nDotL;
+    // looked up off the surface along the normal, further where it turns away from the light,
+    // so the faceted sphere does not shadow itself near its terminator
+    const Vec4 offset(normal * (SHADOW_NORMAL_OFFSET * (1.0f - nDotL)));
+    Vec4 shadowVert = pass->lightMatrix * (world + offset);
+    shadowVert *= (1.0f / shadowVert.w);
+    if (shadowVert.x <= 1 && shadowVert.x >= 0 &&
+        shadowVert.y <= 1 && shadowVert.y >= 0 &&
+        shadowVert.z <= 1 && shadowVert.z >= 0) {
+        float lit = pass->shadow->textureCompare(shadowVert.x, shadowVert.y, shadowVert.z + 0.00001f);
+        lightColor *= 0.5f + 0.5f * lit;
+    }
+
+    Vec3 color = lightColor.Trim();
+    const Vec3 position = world.Trim();
+    for (int i = 0; i < tileLightNum; i++) {
+        const PointLight &light = pass->lights[tileLights[i]];
+        Vec3 toLight = light.position - position;
+        float distSqr = toLight.GetSquaredLength();
+        if (distSqr >= light.radius * light.radius)
+            continue;
+        float dist = sqrtf(distSqr);
+        toLight *= 1.0f / max(dist, 0.0001f);
+        float nDotLight = normal.DotProduct(toLight);
+        if (nDotLight <= 0)
+            continue;
+        float falloff = 1.0f - dist / light.radius;
+        float intensity = nDotLight * falloff * falloff;
+        if (light.cosOuter > -1.0f) {
+            float cosAngle = -light.direction.DotProduct(toLight);
+            float spot = (cosAngle - light.cosOuter) / (light.cosInner - light.cosOuter);
+            intensity *= max(0.0f, min(1.0f, spot));
+        }
+        color += light.color * intensity;
+    }
+    return color;
+}
+
+void lightTiles(LightingPass *pass) {
+    const int size = LIGHT_TILE_SIZE;
+    const int width = pass->fb->width, height = pass->fb->height;
+    std::vector<int> tileLights(max(pass->lightNum, 1));
+    float depths[size * size];
+    bool covered[size * size];
+    long long evaluations = 0;
+    for (;;) {
+        int tile = pass->nextTile.fetch_add(1);
+        if (tile >= pass->tilesX * pass->tilesY)
+            break;
+        int minX = (tile % pass->tilesX) * size, minY = (tile / pass->tilesX) * size;
+        int maxX = min(width, minX + size) - 1, maxY = min(height, minY + size) - 1;
+
+        // depth range of the covered pixels
+        float minZ = 0, maxZ = 0;
+        int coveredNum = 0;
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                int i = (y - minY) * size + x - minX;
+                covered[i] = (loadPacked(pass->targets.normal, x, height - 1 - y) & 0x00ffffffu) != 0;
+                if (!covered[i]) continue;
+                depths[i] = readDepth(pass->db, x, y);
+                minZ = coveredNum == 0 ? depths[i] : min(minZ, depths[i]);
+                maxZ = coveredNum == 0 ? depths[i] : max(maxZ, depths[i]);
+                coveredNum++;
+            }
+        }
+        if (coveredNum == 0)
+            continue;
+
+        // view space box of the tile between its depth bounds
+        float ndcX[2], ndcY[2];
+        invViewPortTransform(minX, minY, width, height, ndcX[0], ndcY[0]);
+        invViewPortTransform(maxX, maxY, width, height, ndcX[1], ndcY[1]);
+        const float ndcZ[2] = {minZ, maxZ};
+        Vec3 boxMin, boxMax;
+        for (int corner = 0; corner < 8; corner++) {
+            Vec4 view = pass->invProject * Vec4(ndcX[corner & 1], ndcY[(corner >> 1) & 1], ndcZ[corner >> 2], 1);
+            const Vec3 point = (view * (1.0f / view.w)).Trim();
+            boxMin = corner == 0 ? point : Vec3(min(boxMin.x, point.x), min(boxMin.y, point.y), min(boxMin.z, point.z));
+            boxMax = corner == 0 ? point : Vec3(max(boxMax.x, point.x), max(boxMax.y, point.y), max(boxMax.z, point.z));
+        }
+        int tileLightNum = cullLights(pass, boxMin, boxMax, tileLights.data());
+        evaluations += (long long) coveredNum * tileLightNum;
+
+        for (int y = minY; y <= maxY; y++) {
+            int row = height - 1 - y;
+            for (int x = minX; x <= maxX; x++) {
+                int i = (y - minY) * size + x - minX;
+                if (!covered[i]) continue;
+                float pixelX, pixelY;
+                invViewPortTransform(x, y, width, height, pixelX, pixelY);
+                Vec4 world = pass->invViewProject * Vec4(pixelX, pixelY, depths[i], 1);
+                world *= 1.0f / world.w;
+                unsigned char nr, ng, nb, ar, ag, ab;
+                loadPixel(pass->targets.normal, x, row, nr, ng, nb);
+                loadPixel(pass->targets.albedo, x, row, ar, ag, ab);
+                const Vec3 normal = (Vec3(nr, ng, nb) * (2.0f / 255.0f) - Vec3(1, 1, 1)).GetNormalized();
+                const Vec3 light = shadePixel(pass, world, normal, tileLights.data(), tileLightNum);
+                unsigned char cr, cg, cb;
+                scaleColor(Vec3(ar, ag, ab) * INV_SCALE * light, cr, cg, cb);
+                storePixel(pass->fb, x, row, cr, cg, cb);
+            }
+        }
+    }
+    pass->evaluations += evaluations;
+}
+
+long long lightGBuffer(FrameBuffer *fb, const DepthBuffer *db) {
+    std::vector<Vec3> viewCenters(pointLightNum);
+    for (int i = 0; i < pointLightNum; i++)
+        viewCenters[i] = (viewMatrix * Vec4(pointLights[i].position, 1)).Trim();
+
+    LightingPass pass;
+    pass.fb = fb;
+    pass.db = db;
+    pass.targets = gbuffer;
+    pass.invProject = projectMatrix.GetInverse();
+    pass.invViewProject = (projectMatrix * viewMatrix).GetInverse();
+    pass.lightMatrix = uniformBlock.lightMatrix;
+    pass.lightDirection = uniformBlock.lightDirection;
+    pass.ambient = uniformBlock.ambient;
+    pass.diffuse = uniformBlock.diffuse;
+    pass.shadow = depthTexture;
+    pass.lights = pointLights;
+    pass.viewCenters = viewCenters.data();
+    pass.lightNum = pointLightNum;
+    pass.tilesX = (fb->width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    pass.tilesY = (fb->height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+    pass.nextTile = 0;
+    pass.evaluations = 0;
+
+    int threads = lightingThreads > 0 ? lightingThreads : max(1, (int) std::thread::hardware_concurrency());
+    if (lightingWorkers == nullptr || lightingWorkers->size() != threads - 1) {
+        delete lightingWorkers;
+        lightingWorkers = new LightingWorkers(threads - 1);
+    }
+    lightingWorkers->light(&pass);
+    return pass.evaluations;
+}
@@ -0,0 +1,45 @@
+#ifndef DEFERRED_H_
+#define DEFERRED_H_
+
+#include "../graphicLib/graphicLib.h"
+
+// point light, or spot light around direction when cosOuter > -1
+struct PointLight {
+    Vec3 position;
+    Vec3 color;
+    float radius; //no light beyond it
+    Vec3 direction;
+    float cosInner, cosOuter;
+};
+
+// Targets of the geometry pass, depth goes to the frame depth buffer.
+// A zero normal marks pixels without geometry.
+struct GBuffer {
+    FrameBuffer *albedo;
+    FrameBuffer *normal;
+};
+
+extern RENDER_LOCAL GBuffer gbuffer;
+// while set, the objects draw into gbuffer instead of shading
+extern RENDER_LOCAL bool deferredPass;
+extern RENDER_LOCAL PointLight *pointLights;
+extern RENDER_LOCAL int pointLightNum;
+// threads of lightGBuffer, the calling thread included, 0 for one per core,
+// the others wait between frames until releaseDeferred
+extern RENDER_LOCAL int lightingThreads;
+
+// scatters lightNum point and spot lights over the ground
+void initDeferred(int lightNum);
+
+void releaseDeferred();
+
+// sizes the G-buffer targets and clears them
+void beginGBuffer(int width, int height);
+
+// Lights the G-buffer pixels into fb with the directional light, its shadow map
+// and the point lights. Every LIGHT_TILE_SIZE tile keeps the lights touching the
+// view space box of its depth range. Returns the light evaluations, covered
+// pixels times the lights of their tile.
+long long lightGBuffer(FrameBuffer *fb, const DepthBuffer *db);
+
+#endif /* DEFERRED_H_ */
@@ -1,8 +1,16 @@
+#include <chrono>
+#include <string>
 #include "frame.h"
 #include "objects.h"
 #include "sight/sight.h"
 
-Sight *sight = NULL;
+RENDER_LOCAL Sight *sight = NULL;
+RENDER_LOCAL bool prepassFlag = false;
+RENDER_LOCAL bool deferredFlag = false;
+RENDER_LOCAL int deferredLightNum = 256;
+RENDER_LOCAL PassStats passStats = {0, 0, 0, 0, 0, 0};
+RENDER_LOCAL int textureLayout = LAYOUT_LINEAR;
+RENDER_LOCAL int textureFormat = TEXEL_RGBA8;
 
 void buildCamera() {
     Mat44 trans, rotX, rotY;
@@ -12,6 +20,19 @@ void buildCamera() {
     viewMatrix = rotX * rotY * trans;
 }
 
+void finishFrame() {
+    resolveFrameBuffer(frontBuffer);
+//	flush(frontBuffer);
+    swapBuffer();
+    resetFrameArena();
+}
+
+void renderScene() {
+    renderCube();
+    renderSquare();
+    renderSphere();
+}
+
 void draw() {
     clearScreen(frontBuffer, 128, 178, 204);
 //	clearScreenFast(frontBuffer,200);
@@ -22,28 +43,76 @@ void draw() {
 
     renderShadowMap(renderShadow);
 
-    renderCube();
-    renderSquare();
-    renderSphere();
-
-//	flush(frontBuffer);
-    swapBuffer();
+    if (deferredFlag && frameSamples == 1) {
+        beginGBuffer(depthBuffer->width, depthBuffer->height);
+        long long fragments = rasterFragments;
+        deferredPass = true;
+        renderScene();
+        deferredPass = false;
+        passStats.shadedFragments += rasterFragments - fragments;
+        auto start = std::chrono::steady_clock::now();
+        passStats.lightEvaluations += lightGBuffer(frontBuffer, depthBuffer);
+        passStats.lightingSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        passStats.frames++;
+        finishFrame();
+        return;
+    }
+    if (prepassFlag && frameSamples == 1) {
+        auto start = std::chrono::steady_clock::now();
+        long long fragments = rasterFragments;
+        depthPrepass = true;
+        renderScene();
+        depthPrepass = false;
+        depthTestMode = DEPTH_TEST_EQUAL;
+        passStats.prepassFragments += rasterFragments - fragments;
+        passStats.prepassSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    long long fragments = rasterFragments;
+    renderScene();
+    depthTestMode = DEPTH_TEST_LESS;
+    passStats.shadedFragments += rasterFragments - fragments;
+    passStats.frames++;
+    finishFrame();
 }
 
 void buildProjectMatrix(int w, int h) {
     clipNear = 1;
     float fAspect = (float) w / (float) h;
-    projectMatrix = perspective(60.0, fAspect, clipNear, 100.0);
+    if (frameDepthFormat == DEPTH_FLOAT32_REV)
+        projectMatrix = perspectiveReversed(60.0, fAspect, clipNear, 100.0);
+    else
+        projectMatrix = perspective(60.0, fAspect, clipNear, 100.0);
+}
+
+// output directory of the asset import, set by the build
+#ifndef TEXTURE_IMPORT_DIR
+#define TEXTURE_IMPORT_DIR "texture"
+#endif
+
+// name.dds from the asset import when it holds textureFormat, else dir/name.bmp encoded at load
+Texture *loadTexture(const std::string &dir, const std::string &name) {
+    if (textureFormat != TEXEL_RGBA8) {
+        Texture *texture = new Texture((TEXTURE_IMPORT_DIR "/" + name + ".dds").c_str());
+        if (texture->sampler != nullptr && texture->sampler->getTexelFormat() == textureFormat)
+            return texture;
+        delete texture;
+    }
+    return new Texture((dir + name + ".bmp").c_str(), textureFormat);
 }
 
 void initTextures() {
-    texWood = new Texture("../texture/cube24.bmp");
-    texGround = new Texture("../texture/ground24.bmp");
+    texWood = loadTexture("../texture/", "cube24");
+    texGround = loadTexture("../texture/", "ground24");
     if (!texWood->sampler && !texGround->sampler) {
         delete texWood;
         delete texGround;
-        texWood = new Texture("texture/cube24.bmp");
-        texGround = new Texture("texture/ground24.bmp");
+        texWood = loadTexture("texture/", "cube24");
+        texGround = loadTexture("texture/", "ground24");
+    }
+    Texture *textures[] = {texWood, texGround};
+    for (Texture *texture : textures) {
+        if (texture->sampler != nullptr)
+            texture->sampler->setTexelLayout(textureLayout);
     }
 }
 
@@ -53,10 +122,13 @@ void releaseTextures() {
 }
 
 void init() {
-    initFixFace();
+    initFrameArena();
+    initRasterVariants();
+    initShaderVariants();
     initUniforms();
     initTextures();
     initShadow(256, 256);
+    initDeferred(deferredLightNum);
     initCube();
     initSquare();
     initSphere();
@@ -78,14 +150,17 @@ void release() {
     releaseSquare();
     releaseCube();
     releaseShadow();
+    releaseDeferred();
     releaseTextures();
-    releaseFixFace();
+    releaseFrameArena();
     releaseDevice2Buf(&frameBuffer1, &frameBuffer2, &depthBuffer);
 }
 
 void resize(int width, int height) {
-    releaseDevice2Buf(&frameBuffer1, &frameBuffer2, &depthBuffer);
-    initDevice2Buf(&frameBuffer1, &frameBuffer2, &depthBuffer, width, height);
+    if (presenter != nullptr)
+        presenter->resize(width, height);
+    resizeDevice2Buf(&frameBuffer1, &frameBuffer2, &depthBuffer, width, height, framePixelFormat, frameLayout,
+                     frameDepthFormat, frameSamples);
     buildProjectMatrix(width, height);
 }
 
@@ -116,3 +191,16 @@ void act() {
         eyeY = -sight->sy;
     }
 }
+
+void placeSight(float x, float y, float z, float xrot, float yrot) {
+    if (sight == NULL)
+        return;
+    sight->sx = x;
+    sight->sy = y;
+    sight->sz = z;
+    sight->xrot = xrot;
+    sight->yrot = yrot;
+    eyeZ = -sight->sz;
+    eyeX = -sight->sx;
+    eyeY = -sight->sy;
+}
@@ -4,6 +4,29 @@
 #include "graphicLib/graphicLib.h"
 #include "key/key.h"
 
+// summed over the frames drawn, fragments are the ones passing the depth test
+struct PassStats {
+    int frames;
+    long long shadedFragments;
+    long long prepassFragments;
+    double prepassSeconds;
+    long long lightEvaluations; //deferred frames, covered pixels times the lights of their tile
+    double lightingSeconds;
+};
+
+// lays down the depth of the opaque draws first, the color pass then shades
+// each pixel once with DEPTH_TEST_EQUAL. Single sampled frames only.
+extern RENDER_LOCAL bool prepassFlag;
+// geometry into a G-buffer, then tiled lighting with deferredLightNum point and spot lights.
+// Single sampled frames only, the prepass does not apply.
+extern RENDER_LOCAL bool deferredFlag;
+extern RENDER_LOCAL int deferredLightNum;
+extern RENDER_LOCAL PassStats passStats;
+// LAYOUT_LINEAR, LAYOUT_TILED4 or LAYOUT_TILED8 texel storage of the loaded textures
+extern RENDER_LOCAL int textureLayout;
+// TEXEL_RGBA8, or TEXEL_BC1, TEXEL_BC4 or TEXEL_BC5 blocks kept compressed in the loaded textures
+extern RENDER_LOCAL int textureFormat;
+
 void draw();
 
 void init();
@@ -14,4 +37,6 @@ void resize(int width, int height);
 
 void act();
 
+void placeSight(float x, float y, float z, float xrot, float yrot);
+
 #endif /* FRAME_H_ */
@@ -0,0 +1,58 @@
+#include "blendState.h"
+
+template<int SrcFactor, int DstFactor>
+BlendFunc resolveOp(int op) {
+    if (op == BLEND_OP_SUBTRACT)
+        return blendPixels<SrcFactor, DstFactor, BLEND_OP_SUBTRACT>;
+    if (op == BLEND_OP_REVERSE_SUBTRACT)
+        return blendPixels<SrcFactor, DstFactor, BLEND_OP_REVERSE_SUBTRACT>;
+    return blendPixels<SrcFactor, DstFactor, BLEND_OP_ADD>;
+}
+
+template<int SrcFactor>
+BlendFunc resolveDstFactor(int dstFactor, int op) {
+    switch (dstFactor) {
+        case BLEND_ZERO:
+            return resolveOp<SrcFactor, BLEND_ZERO>(op);
+        case BLEND_ONE:
+            return resolveOp<SrcFactor, BLEND_ONE>(op);
+        case BLEND_SRC_COLOR:
+            return resolveOp<SrcFactor, BLEND_SRC_COLOR>(op);
+        case BLEND_ONE_MINUS_SRC_COLOR:
+            return resolveOp<SrcFactor, BLEND_ONE_MINUS_SRC_COLOR>(op);
+        case BLEND_SRC_ALPHA:
+            return resolveOp<SrcFactor, BLEND_SRC_ALPHA>(op);
+        case BLEND_ONE_MINUS_SRC_ALPHA:
+            return resolveOp<SrcFactor, BLEND_ONE_MINUS_SRC_ALPHA>(op);
+        case BLEND_DST_COLOR:
+            return resolveOp<SrcFactor, BLEND_DST_COLOR>(op);
+        default:
+            return resolveOp<SrcFactor, BLEND_ONE_MINUS_DST_COLOR>(op);
+    }
+}
+
+BlendFunc resolveBlend(const BlendState &state) {
+    // min and max ignore the factors
+    if (state.op == BLEND_OP_MIN)
+        return blendPixels<BLEND_ONE, BLEND_ONE, BLEND_OP_MIN>;
+    if (state.op == BLEND_OP_MAX)
+        return blendPixels<BLEND_ONE, BLEND_ONE, BLEND_OP_MAX>;
+    switch (state.srcFactor) {
+        case BLEND_ZERO:
+            return resolveDstFactor<BLEND_ZERO>(state.dstFactor, state.op);
+        case BLEND_ONE:
+            return resolveDstFactor<BLEND_ONE>(state.dstFactor, state.op);
+        case BLEND_SRC_COLOR:
+            return resolveDstFactor<BLEND_SRC_COLOR>(state.dstFactor, state.op);
+        case BLEND_ONE_MINUS_SRC_COLOR:
+            return resolveDstFactor<BLEND_ONE_MINUS_SRC_COLOR>(state.dstFactor, state.op);
+        case BLEND_SRC_ALPHA:
+            return resolveDstFactor<BLEND_SRC_ALPHA>(state.dstFactor, state.op);
+        case BLEND_ONE_MINUS_SRC_ALPHA:
+            return resolveDstFactor<BLEND_ONE_MINUS_SRC_ALPHA>(state.dstFactor, state.op);
+        case BLEND_DST_COLOR:
+            return resolveDstFactor<BLEND_DST_COLOR>(state.dstFactor, state.op);
+        default:
+            return resolveDstFactor<BLEND_ONE_MINUS_DST_COLOR>(state.dstFactor, state.op);
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef BLENDSTATE_H_
+#define BLENDSTATE_H_
+
+#include <smmintrin.h>
+#include "../header/header.h"
+
+// result = src * srcFactor op dst * dstFactor per channel, in 8 bit fixed point.
+// Pixels are packed as packPixel does with the source alpha in the top byte,
+// blended pixels come out opaque.
+struct BlendState {
+    bool enable;
+    int srcFactor, dstFactor;
+    int op;
+};
+
+const BlendState blendOpaque = {false, BLEND_ONE, BLEND_ZERO, BLEND_OP_ADD};
+const BlendState blendAlpha = {true, BLEND_SRC_ALPHA, BLEND_ONE_MINUS_SRC_ALPHA, BLEND_OP_ADD};
+const BlendState blendPremultiplied = {true, BLEND_ONE, BLEND_ONE_MINUS_SRC_ALPHA, BLEND_OP_ADD};
+const BlendState blendAdditive = {true, BLEND_ONE, BLEND_ONE, BLEND_OP_ADD};
+const BlendState blendMultiply = {true, BLEND_DST_COLOR, BLEND_ZERO, BLEND_OP_ADD};
+const BlendState blendMin = {true, BLEND_ONE, BLEND_ONE, BLEND_OP_MIN};
+const BlendState blendMax = {true, BLEND_ONE, BLEND_ONE, BLEND_OP_MAX};
+
+// x * f / 255 rounded to nearest, 16 bit lanes of 0..255
+inline __m128i mulUnorm8(__m128i x, __m128i f) {
+    const __m128i t = _mm_add_epi16(_mm_mullo_epi16(x, f), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+template<int Factor>
+inline __m128i applyBlendFactor(__m128i x, __m128i src, __m128i dst, __m128i srcAlpha) {
+    const __m128i full = _mm_set1_epi16(255);
+    if constexpr (Factor == BLEND_ZERO)
+        return _mm_setzero_si128();
+    else if constexpr (Factor == BLEND_ONE)
+        return x;
+    else if constexpr (Factor == BLEND_SRC_COLOR)
+        return mulUnorm8(x, src);
+    else if constexpr (Factor == BLEND_ONE_MINUS_SRC_COLOR)
+        return mulUnorm8(x, _mm_sub_epi16(full, src));
+    else if constexpr (Factor == BLEND_SRC_ALPHA)
+        return mulUnorm8(x, srcAlpha);
+    else if constexpr (Factor == BLEND_ONE_MINUS_SRC_ALPHA)
+        return mulUnorm8(x, _mm_sub_epi16(full, srcAlpha));
+    else if constexpr (Factor == BLEND_DST_COLOR)
+        return mulUnorm8(x, dst);
+    else
+        return mulUnorm8(x, _mm_sub_epi16(full, dst));
+}
+
+// two pixels widened to 16 bits per channel
+template<int SrcFactor, int DstFactor, int Op>
+inline __m128i blendWide(__m128i src, __m128i dst) {
+    if constexpr (Op == BLEND_OP_MIN) {
+        return _mm_min_epi16(src, dst);
+    } else if constexpr (Op == BLEND_OP_MAX) {
+        return _mm_max_epi16(src, dst);
+    } else {
+        const __m128i srcAlpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(src, 0xff), 0xff);
+        const __m128i s = applyBlendFactor<SrcFactor>(src, src, dst, srcAlpha);
+        const __m128i d = applyBlendFactor<DstFactor>(dst, src, dst, srcAlpha);
+        if constexpr (Op == BLEND_OP_SUBTRACT)
+            return _mm_subs_epu16(s, d);
+        else if constexpr (Op == BLEND_OP_REVERSE_SUBTRACT)
+            return _mm_subs_epu16(d, s);
+        else
+            return _mm_add_epi16(s, d); //saturated by the pack
+    }
+}
+
+template<int SrcFactor, int DstFactor, int Op>
+__m128i blendPixels(__m128i src, __m128i dst) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo = blendWide<SrcFactor, DstFactor, Op>(_mm_unpacklo_epi8(src, zero), _mm_unpacklo_epi8(dst, zero));
+    const __m128i hi = blendWide<SrcFactor, DstFactor, Op>(_mm_unpackhi_epi8(src, zero), _mm_unpackhi_epi8(dst, zero));
+    return _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(0xff000000));
+}
+
+// blends four packed pixels as one BlendState does
+typedef __m128i (*BlendFunc)(__m128i src, __m128i dst);
+
+// the blendPixels instance of state, resolved once per draw instead of switching per pixel
+BlendFunc resolveBlend(const BlendState &state);
+
+inline unsigned int blendPixel(BlendFunc blend, unsigned int src, unsigned int dst) {
+    return _mm_cvtsi128_si32(blend(_mm_cvtsi32_si128(src), _mm_cvtsi32_si128(dst)));
+}
+
+// colors in 0..1, truncated like scaleColor, alpha rounded
+inline __m128i packColors(int format, __m128 red, __m128 green, __m128 blue, __m128 alpha) {
+    const __m128 scale = _mm_set1_ps(255.0f);
+    __m128i r = _mm_cvttps_epi32(_mm_mul_ps(red, scale));
+    const __m128i g = _mm_cvttps_epi32(_mm_mul_ps(green, scale));
+    __m128i b = _mm_cvttps_epi32(_mm_mul_ps(blue, scale));
+    const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(alpha, scale));
+    if (format == PIXEL_RGBA8) {
+        const __m128i t = r;
+        r = b;
+        b = t;
+    }
+    // bytes b0..b3 g0..g3 r0..r3 a0..a3, then gathered per pixel
+    const __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(b, g), _mm_packs_epi32(r, a));
+    return _mm_shuffle_epi8(bytes, _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15));
+}
+
+inline unsigned int packColor(int format, unsigned char r, unsigned char g, unsigned char b, float alpha) {
+    int a = _mm_cvtss_si32(_mm_set_ss(alpha * 255.0f));
+    return (packPixel(format, r, g, b) & 0x00ffffffu) | ((unsigned int) max(0, min(255, a)) << 24);
+}
+
+#endif /* BLENDSTATE_H_ */
@@ -0,0 +1,94 @@
+#ifndef DEPTHFORMAT_H_
+#define DEPTHFORMAT_H_
+
+#include "../header/header.h"
+
+// Storage and tests of one depth format, depth arrives as ndc z. pass is the
+// regular test, equal the one of DEPTH_TEST_EQUAL draws after a depth prepass.
+// The fixed point formats store window depth z * 0.5 + 0.5.
+template<int Format>
+struct DepthTraits;
+
+template<>
+struct DepthTraits<DEPTH_FLOAT32> {
+    typedef float Stored;
+    static constexpr float minZ = -1.0f, maxZ = 1.0f;
+
+    static Stored store(float z) { return z; }
+
+    static float load(Stored depth) { return depth; }
+
+    static bool pass(Stored depth, Stored stored) { return depth <= stored; }
+
+    static bool equal(Stored depth, Stored stored) { return depth == stored; }
+
+    static Stored clearValue() { return 1.0f; }
+};
+
+template<>
+struct DepthTraits<DEPTH_UNORM16> {
+    typedef unsigned short Stored;
+    static constexpr float minZ = -1.0f, maxZ = 1.0f;
+
+    static Stored store(float z) { return (Stored) ((z * 0.5f + 0.5f) * 65535.0f + 0.5f); }
+
+    static float load(Stored depth) { return depth * (2.0f / 65535.0f) - 1.0f; }
+
+    static bool pass(Stored depth, Stored stored) { return depth <= stored; }
+
+    static bool equal(Stored depth, Stored stored) { return depth == stored; }
+
+    static Stored clearValue() { return 0xffff; }
+};
+
+template<>
+struct DepthTraits<DEPTH_FIXED24> {
+    typedef unsigned int Stored; //upper 8 bits unused
+    static constexpr float minZ = -1.0f, maxZ = 1.0f;
+
+    static Stored store(float z) { return (Stored) ((z * 0.5f + 0.5f) * 16777215.0f + 0.5f); }
+
+    static float load(Stored depth) { return (depth & 0xffffff) * (2.0f / 16777215.0f) - 1.0f; }
+
+    static bool pass(Stored depth, Stored stored) { return depth <= (stored & 0xffffff); }
+
+    static bool equal(Stored depth, Stored stored) { return depth == (stored & 0xffffff); }
+
+    static Stored clearValue() { return 0xffffff; }
+};
+
+// near plane at 1, far plane at 0, float precision grows towards the far plane
+template<>
+struct DepthTraits<DEPTH_FLOAT32_REV> {
+    typedef float Stored;
+    static constexpr float minZ = 0.0f, maxZ = 1.0f;
+
+    static Stored store(float z) { return z; }
+
+    static float load(Stored depth) { return depth; }
+
+    static bool pass(Stored depth, Stored stored) { return depth >= stored; }
+
+    static bool equal(Stored depth, Stored stored) { return depth == stored; }
+
+    static Stored clearValue() { return 0.0f; }
+};
+
+// no depth buffer bound, only the ndc z range is clipped
+template<>
+struct DepthTraits<DEPTH_NONE> {
+    typedef float Stored;
+    static constexpr float minZ = -1.0f, maxZ = 1.0f;
+
+    static Stored store(float z) { return z; }
+
+    static float load(Stored depth) { return depth; }
+
+    static bool pass(Stored, Stored) { return true; }
+
+    static bool equal(Stored, Stored) { return true; }
+
+    static Stored clearValue() { return 1.0f; }
+};
+
+#endif /* DEPTHFORMAT_H_ */
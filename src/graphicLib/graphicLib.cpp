@@ -1,56 +1,165 @@
 #include "graphicLib.h"
 #include "shader/shader.h"
-#include <utility>
-#include <array>
-
-float eyeX, eyeY, eyeZ, clipNear;
-Face *nFace1;
-Face *nFace2;
-bool blendFlag = false;
-FrameBuffer *frontBuffer = nullptr;
-FrameBuffer *backBuffer = nullptr;
-FrameBuffer *frameBuffer1 = nullptr;
-FrameBuffer *frameBuffer2 = nullptr;
-DepthBuffer *depthBuffer = nullptr;
-bool buffersReady = false;
-
-unsigned char *screenBits = nullptr;
-
-void initFrameBuffer(FrameBuffer **pfb, int width, int height) {
-    *pfb = (FrameBuffer *) malloc(sizeof(FrameBuffer));
-    (*pfb)->width = width;
-    (*pfb)->height = height;
-    (*pfb)->colorBuffer = new unsigned char[width * height * 3];
-    memset((*pfb)->colorBuffer, 0, sizeof(unsigned char) * width * height * 3);
+#include "rasterVariant.h"
+
+RENDER_LOCAL float eyeX, eyeY, eyeZ, clipNear;
+RENDER_LOCAL Arena *frameArena = nullptr;
+RENDER_LOCAL bool arenaStatsFlag = false;
+RENDER_LOCAL BlendState blendState = blendOpaque;
+RENDER_LOCAL BlendFunc blendFunc = nullptr;
+RENDER_LOCAL FrameBuffer *secondTarget = nullptr;
+RENDER_LOCAL DrawCall uniformUpdate = nullptr;
+RENDER_LOCAL bool rasterVariantFlag = true;
+RENDER_LOCAL int depthTestMode = DEPTH_TEST_LESS;
+RENDER_LOCAL bool depthPrepass = false;
+RENDER_LOCAL VertexShader prepassVertShader = nullptr;
+RENDER_LOCAL long long rasterFragments = 0;
+RENDER_LOCAL bool scissorFlag = false;
+RENDER_LOCAL Rect scissorRect;
+RENDER_LOCAL FrameBuffer *frontBuffer = nullptr;
+RENDER_LOCAL FrameBuffer *backBuffer = nullptr;
+RENDER_LOCAL FrameBuffer *frameBuffer1 = nullptr;
+RENDER_LOCAL FrameBuffer *frameBuffer2 = nullptr;
+RENDER_LOCAL DepthBuffer *depthBuffer = nullptr;
+RENDER_LOCAL int framePixelFormat = PIXEL_BGRA8;
+RENDER_LOCAL int frameLayout = LAYOUT_LINEAR;
+RENDER_LOCAL int frameDepthFormat = DEPTH_FLOAT32;
+RENDER_LOCAL int frameSamples = 1;
+RENDER_LOCAL bool buffersReady = false;
+
+RENDER_LOCAL Presenter *presenter = nullptr;
+
+#define MAX_SHADER_VARIANTS 8
+
+struct ShaderVariants {
+    FragmentShader fs;
+    DrawVariant variants[VARIANT_COUNT];
+};
+
+RENDER_LOCAL ShaderVariants shaderVariants[MAX_SHADER_VARIANTS];
+RENDER_LOCAL int shaderVariantNum = 0;
+
+void calcTiles(int layout, int width, int height, int &tilesX, int &tilesY) {
+    if (layout == LAYOUT_LINEAR) {
+        tilesX = tilesY = 0;
+        return;
+    }
+    int tileSize = 1 << tileShift(layout);
+    tilesX = (width + tileSize - 1) / tileSize;
+    tilesY = (height + tileSize - 1) / tileSize;
+}
+
+// elements allocated for a buffer, tiled buffers are padded to whole tiles
+int bufferElements(int layout, int width, int height, int tilesX, int tilesY) {
+    if (layout == LAYOUT_LINEAR)
+        return width * height;
+    return (tilesX * tilesY) << (tileShift(layout) * 2);
+}
+
+FrameBuffer *newFrameBuffer() {
+    FrameBuffer *fb = (FrameBuffer *) malloc(sizeof(FrameBuffer));
+    fb->colorBuffer = nullptr;
+    fb->external = false;
+    fb->capacity = 0;
+    fb->samples = 1;
+    fb->sampleColors = nullptr;
+    fb->sampleExpanded = nullptr;
+    fb->sampleCapacity = 0;
+    fb->expandedCapacity = 0;
+    return fb;
+}
+
+void initFrameBuffer(FrameBuffer **pfb, int width, int height, int format, int layout) {
+    *pfb = newFrameBuffer();
+    resizeFrameBuffer(*pfb, width, height, format, layout);
+}
+
+void initFrameBufferSurface(FrameBuffer **pfb, unsigned char *pixels, int width, int height, int stride, int format) {
+    *pfb = newFrameBuffer();
+    attachFrameBufferSurface(*pfb, pixels, width, height, stride, format);
+}
+
+void resizeFrameBuffer(FrameBuffer *fb, int width, int height, int format, int layout) {
+    if (fb->external) {
+        fb->colorBuffer = nullptr;
+        fb->external = false;
+    }
+    fb->width = width;
+    fb->height = height;
+    fb->format = format;
+    fb->stride = width * pixelSize(format);
+    fb->layout = layout;
+    calcTiles(layout, width, height, fb->tilesX, fb->tilesY);
+    int size = bufferElements(layout, width, height, fb->tilesX, fb->tilesY) * pixelSize(format);
+    reserveTarget(&fb->colorBuffer, fb->capacity, size);
+}
+
+void attachFrameBufferSurface(FrameBuffer *fb, unsigned char *pixels, int width, int height, int stride, int format) {
+    if (!fb->external)
+        freeTarget(fb->colorBuffer);
+    fb->width = width;
+    fb->height = height;
+    fb->format = format;
+    fb->stride = stride;
+    fb->external = true;
+    fb->capacity = 0;
+    fb->layout = LAYOUT_LINEAR;
+    fb->tilesX = fb->tilesY = 0;
+    fb->colorBuffer = pixels;
+}
+
+void setFrameBufferSamples(FrameBuffer *fb, int samples) {
+    fb->samples = samples;
+    if (samples <= 1)
+        return;
+    int size = bufferElements(fb->layout, fb->width, fb->height, fb->tilesX, fb->tilesY);
+    unsigned char *colors = (unsigned char *) fb->sampleColors;
+    reserveTarget(&colors, fb->sampleCapacity, size * samples * sizeof(unsigned int));
+    fb->sampleColors = (unsigned int *) colors;
+    reserveTarget(&fb->sampleExpanded, fb->expandedCapacity, size);
 }
 
 void releaseFrameBuffer(FrameBuffer **pfb) {
     if (*pfb == nullptr)
         return;
-    delete[] (*pfb)->colorBuffer;
+    if (!(*pfb)->external)
+        freeTarget((*pfb)->colorBuffer);
+    freeTarget((unsigned char *) (*pfb)->sampleColors);
+    freeTarget((*pfb)->sampleExpanded);
     free(*pfb);
     *pfb = nullptr;
 }
 
-void initDepthBuffer(DepthBuffer **pdb, int width, int height) {
+void initDepthBuffer(DepthBuffer **pdb, int width, int height, int layout, int format, int samples) {
     *pdb = (DepthBuffer *) malloc(sizeof(DepthBuffer));
-    (*pdb)->width = width;
-    (*pdb)->height = height;
-    (*pdb)->depthBuffer = new float[width * height];
-    memset((*pdb)->depthBuffer, 0, sizeof(float) * width * height);
+    (*pdb)->depthBuffer = NULL;
+    (*pdb)->capacity = 0;
+    resizeDepthBuffer(*pdb, width, height, layout, format, samples);
+}
+
+void resizeDepthBuffer(DepthBuffer *db, int width, int height, int layout, int format, int samples) {
+    db->width = width;
+    db->height = height;
+    db->format = format;
+    db->samples = samples;
+    db->layout = layout;
+    calcTiles(layout, width, height, db->tilesX, db->tilesY);
+    int size = bufferElements(layout, width, height, db->tilesX, db->tilesY) * depthSize(format) * samples;
+    reserveTarget(&db->depthBuffer, db->capacity, size);
 }
 
 void releaseDepthBuffer(DepthBuffer **pdb) {
     if (*pdb == NULL)
         return;
-    delete[] (*pdb)->depthBuffer;
+    freeTarget((*pdb)->depthBuffer);
     free(*pdb);
     *pdb = NULL;
 }
 
-void initDevice(FrameBuffer **pfb, DepthBuffer **pdb, int width, int height) {
-    initFrameBuffer(pfb, width, height);
-    initDepthBuffer(pdb, width, height);
+void initDevice(FrameBuffer **pfb, DepthBuffer **pdb, int width, int height, int format, int layout,
+                int depthFormat) {
+    initFrameBuffer(pfb, width, height, format, layout);
+    initDepthBuffer(pdb, width, height, layout, depthFormat);
 }
 
 void releaseDevice(FrameBuffer **pfb, DepthBuffer **pdb) {
@@ -58,10 +167,53 @@ void releaseDevice(FrameBuffer **pfb, DepthBuffer **pdb) {
     releaseDepthBuffer(pdb);
 }
 
-void initDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height) {
-    initFrameBuffer(pfb1, width, height);
-    initFrameBuffer(pfb2, width, height);
-    initDepthBuffer(pdb, width, height);
+// Front and back buffer each need a surface of their own, with a single one they would
+// alias and the frame in flight would be shown. Otherwise both buffers stay owned.
+bool adoptSurfaces(Surface *surfaces, int format, int layout) {
+    if (presenter == nullptr || layout != LAYOUT_LINEAR || presenter->getSurfaces(surfaces) != 2)
+        return false;
+    return surfaces[0].format == format && surfaces[1].format == format;
+}
+
+void initDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height, int format,
+                    int layout, int depthFormat, int samples) {
+    // render straight into the presenter's surfaces when their layout matches, present is then a flip
+    Surface surfaces[2];
+    bool adopt = adoptSurfaces(surfaces, format, layout);
+    FrameBuffer **pfbs[2] = {pfb1, pfb2};
+    for (int i = 0; i < 2; i++) {
+        if (adopt) {
+            const Surface &surface = surfaces[i];
+            initFrameBufferSurface(pfbs[i], surface.pixels, width, height, surface.stride, format);
+        } else
+            initFrameBuffer(pfbs[i], width, height, format, layout);
+        setFrameBufferSamples(*pfbs[i], samples);
+    }
+    initDepthBuffer(pdb, width, height, layout, depthFormat, samples);
+    frontBuffer = *pfb1;
+    backBuffer = *pfb2;
+    buffersReady = false;
+}
+
+void resizeDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height, int format,
+                      int layout, int depthFormat, int samples) {
+    if (*pfb1 == nullptr || *pfb2 == nullptr || *pdb == nullptr) {
+        releaseDevice2Buf(pfb1, pfb2, pdb);
+        initDevice2Buf(pfb1, pfb2, pdb, width, height, format, layout, depthFormat, samples);
+        return;
+    }
+    Surface surfaces[2];
+    bool adopt = adoptSurfaces(surfaces, format, layout);
+    FrameBuffer *fbs[2] = {*pfb1, *pfb2};
+    for (int i = 0; i < 2; i++) {
+        if (adopt) {
+            const Surface &surface = surfaces[i];
+            attachFrameBufferSurface(fbs[i], surface.pixels, width, height, surface.stride, format);
+        } else
+            resizeFrameBuffer(fbs[i], width, height, format, layout);
+        setFrameBufferSamples(fbs[i], samples);
+    }
+    resizeDepthBuffer(*pdb, width, height, layout, depthFormat, samples);
     frontBuffer = *pfb1;
     backBuffer = *pfb2;
     buffersReady = false;
@@ -75,10 +227,43 @@ void releaseDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb
     releaseDepthBuffer(pdb);
 }
 
+// every pixel back to a single color
+void clearSamples(FrameBuffer *fb) {
+    if (fb->samples > 1)
+        memset(fb->sampleExpanded, 0, bufferElements(fb->layout, fb->width, fb->height, fb->tilesX, fb->tilesY));
+}
+
 void clearScreen(FrameBuffer *fb, unsigned char red, unsigned char green, unsigned char blue) {
+    clearSamples(fb);
+    if (fb->layout != LAYOUT_LINEAR) {
+        // tiles are contiguous, padding pixels are cleared along with the image
+        int size = bufferElements(fb->layout, fb->width, fb->height, fb->tilesX, fb->tilesY);
+        if (fb->format != PIXEL_RGB8) {
+            unsigned int pixel = packPixel(fb->format, red, green, blue);
+            unsigned int *pixels = (unsigned int *) fb->colorBuffer;
+            for (int i = 0; i < size; i++)
+                pixels[i] = pixel;
+            return;
+        }
+        for (int i = 0; i < size; i++) {
+            fb->colorBuffer[i * 3] = red;
+            fb->colorBuffer[i * 3 + 1] = green;
+            fb->colorBuffer[i * 3 + 2] = blue;
+        }
+        return;
+    }
+    if (fb->format != PIXEL_RGB8) {
+        unsigned int pixel = packPixel(fb->format, red, green, blue);
+        for (int i = 0; i < fb->height; i++) {
+            unsigned int *pixels = (unsigned int *) (fb->colorBuffer + i * fb->stride);
+            for (int j = 0; j < fb->width; j++)
+                pixels[j] = pixel;
+        }
+        return;
+    }
     for (int i = 0; i < fb->height; i++) {
         for (int j = 0; j < fb->width; j++) {
-            int index = (i * fb->width + j) * 3;
+            int index = i * fb->stride + j * 3;
             fb->colorBuffer[index] = red;
             fb->colorBuffer[index + 1] = green;
             fb->colorBuffer[index + 2] = blue;
@@ -87,31 +272,152 @@ void clearScreen(FrameBuffer *fb, unsigned char red, unsigned char green, unsign
 }
 
 void clearScreenFast(FrameBuffer *fb, unsigned char color) {
-    int size = fb->width * fb->height * 3;
-    memset(fb->colorBuffer, color * sizeof(unsigned char), size);
+    clearSamples(fb);
+    if (fb->layout != LAYOUT_LINEAR) {
+        int size = bufferElements(fb->layout, fb->width, fb->height, fb->tilesX, fb->tilesY);
+        memset(fb->colorBuffer, color, size * pixelSize(fb->format));
+        return;
+    }
+    int size = fb->width * pixelSize(fb->format);
+    for (int i = 0; i < fb->height; i++)
+        memset(fb->colorBuffer + i * fb->stride, color * sizeof(unsigned char), size);
+}
+
+template<int Format>
+void clearDepthRows(DepthBuffer *db, int minRow, int maxRow, int minX, int maxX) {
+    typedef DepthTraits<Format> Depth;
+    typename Depth::Stored *depths = (typename Depth::Stored *) db->depthBuffer;
+    typename Depth::Stored value = Depth::clearValue();
+    int samples = db->samples;
+    if (minRow == 0 && maxRow == db->height - 1 && minX == 0 && maxX == db->width - 1) {
+        // the whole buffer is contiguous, tile padding is cleared along with the image
+        int size = bufferElements(db->layout, db->width, db->height, db->tilesX, db->tilesY) * samples;
+        for (int i = 0; i < size; i++)
+            depths[i] = value;
+        return;
+    }
+    for (int i = minRow; i <= maxRow; i++) {
+        for (int j = minX; j <= maxX; j++) {
+            int index = depthIndex(db, j, i) * samples;
+            for (int s = 0; s < samples; s++)
+                depths[index + s] = value;
+        }
+    }
+}
+
+void clearDepthRows(DepthBuffer *db, int minRow, int maxRow, int minX, int maxX) {
+    switch (db->format) {
+        case DEPTH_UNORM16:
+            clearDepthRows<DEPTH_UNORM16>(db, minRow, maxRow, minX, maxX);
+            break;
+        case DEPTH_FIXED24:
+            clearDepthRows<DEPTH_FIXED24>(db, minRow, maxRow, minX, maxX);
+            break;
+        case DEPTH_FLOAT32_REV:
+            clearDepthRows<DEPTH_FLOAT32_REV>(db, minRow, maxRow, minX, maxX);
+            break;
+        default:
+            clearDepthRows<DEPTH_FLOAT32>(db, minRow, maxRow, minX, maxX);
+            break;
+    }
 }
 
 void clearDepth(DepthBuffer *db) {
-    for (int i = 0; i < db->height; i++) {
-        for (int j = 0; j < db->width; j++)
-            db->depthBuffer[i * db->width + j] = 1.0;
+    clearDepthRows(db, 0, db->height - 1, 0, db->width - 1);
+}
+
+void clearScreenRect(FrameBuffer *fb, const Rect &rect, unsigned char red, unsigned char green, unsigned char blue) {
+    for (int i = rect.minY; i <= rect.maxY; i++) {
+        for (int j = rect.minX; j <= rect.maxX; j++) {
+            drawPixel(fb, j, i, red, green, blue);
+            if (fb->samples > 1)
+                fb->sampleExpanded[pixelIndex(fb, j, fb->height - 1 - i)] = 0;
+        }
     }
 }
 
-void flush(FrameBuffer *fb) {
-    for (int i = 0; i < fb->height; i++) {
-        for (int j = 0; j < fb->width; j++) {
-            int index = (i * fb->width + j) * 3;
-            unsigned char red = fb->colorBuffer[index];
-            unsigned char green = fb->colorBuffer[index + 1];
-            unsigned char blue = fb->colorBuffer[index + 2];
-            screenBits[index] = blue;
-            screenBits[index + 1] = green;
-            screenBits[index + 2] = red;
+void clearDepthRect(DepthBuffer *db, const Rect &rect) {
+    clearDepthRows(db, db->height - 1 - rect.maxY, db->height - 1 - rect.minY, rect.minX, rect.maxX);
+}
+
+Rect unionRect(const Rect &a, const Rect &b) {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    return Rect(min(a.minX, b.minX), min(a.minY, b.minY), max(a.maxX, b.maxX), max(a.maxY, b.maxY));
+}
+
+Rect intersectRect(const Rect &a, const Rect &b) {
+    return Rect(max(a.minX, b.minX), max(a.minY, b.minY), min(a.maxX, b.maxX), min(a.maxY, b.maxY));
+}
+
+void readFrameBufferRow(const FrameBuffer *fb, int row, int minX, int maxX, unsigned char *dst) {
+    int size = pixelSize(fb->format);
+    if (fb->layout == LAYOUT_LINEAR) {
+        memcpy(dst, fb->colorBuffer + row * fb->stride + minX * size, (maxX - minX + 1) * size);
+        return;
+    }
+    // walk the tiles the row crosses, only the in-tile offset changes per pixel
+    int shift = tileShift(fb->layout);
+    int mask = (1 << shift) - 1;
+    const unsigned char *tileRow = fb->colorBuffer + (((row >> shift) * fb->tilesX) << (shift * 2)) * size;
+    int inTileRow = row & mask;
+    if (size == 4) {
+        // x and x + 1 are adjacent in Morton order when x is even, copy pixel pairs
+        const unsigned int *tiles = (const unsigned int *) tileRow;
+        unsigned int *out = (unsigned int *) dst;
+        int rowBits = mortonIndex(0, inTileRow);
+        for (int x = minX; x <= maxX;) {
+            const unsigned int *src = tiles + ((x >> shift) << (shift * 2)) + (mortonIndex(x & mask, 0) | rowBits);
+            if ((x & 1) == 0 && x < maxX) {
+                memcpy(out, src, 8);
+                out += 2;
+                x += 2;
+            } else {
+                *out++ = *src;
+                x++;
+            }
         }
+        return;
+    }
+    for (int x = minX; x <= maxX; x++) {
+        const unsigned char *src = tileRow + (((x >> shift) << (shift * 2)) + mortonIndex(x & mask, inTileRow)) * size;
+        memcpy(dst, src, size);
+        dst += size;
     }
 }
 
+void readFrameBufferTiles(const FrameBuffer *fb, unsigned char *dst, int dstStride) {
+    int shift = tileShift(fb->layout), tileSize = 1 << shift;
+    int evenWidth = fb->width & ~1, evenHeight = fb->height & ~1;
+    // a 2x2 quad at even x and row is 4 consecutive pixels, two of each row
+    for (int tileRow = 0; tileRow < evenHeight; tileRow += tileSize) {
+        for (int tileX = 0; tileX < evenWidth; tileX += tileSize) {
+            int tile = (tileRow >> shift) * fb->tilesX + (tileX >> shift);
+            const unsigned int *pixels = (const unsigned int *) fb->colorBuffer + (tile << (shift * 2));
+            int rows = min(tileSize, evenHeight - tileRow), columns = min(tileSize, evenWidth - tileX);
+            for (int y = 0; y < rows; y += 2) {
+                unsigned char *upper = dst + (tileRow + y) * dstStride + tileX * 4;
+                for (int x = 0; x < columns; x += 2) {
+                    const __m128i quad = _mm_loadu_si128((const __m128i *) (pixels + mortonIndex(x, y)));
+                    _mm_storel_epi64((__m128i *) (upper + x * 4), quad);
+                    _mm_storel_epi64((__m128i *) (upper + dstStride + x * 4), _mm_unpackhi_epi64(quad, quad));
+                }
+            }
+        }
+    }
+    if (evenWidth != fb->width) {
+        for (int row = 0; row < evenHeight; row++)
+            readFrameBufferRow(fb, row, evenWidth, evenWidth, dst + row * dstStride + evenWidth * 4);
+    }
+    if (evenHeight != fb->height)
+        readFrameBufferRow(fb, evenHeight, 0, fb->width - 1, dst + evenHeight * dstStride);
+}
+
+void flush(FrameBuffer *fb) {
+    if (presenter != nullptr)
+        presenter->present(fb);
+}
+
 void swapBuffer() {
     if (frontBuffer == frameBuffer1) {
         frontBuffer = frameBuffer2;
@@ -125,57 +431,69 @@ void swapBuffer() {
         buffersReady = true;
         return;
     }
-    FrameBuffer *fb = frontBuffer;
-    for (int i = 0; i < fb->height; i++) {
-        for (int j = 0; j < fb->width; j++) {
-            int index = (i * fb->width + j) * 3;
-            unsigned char red = fb->colorBuffer[index];
-            unsigned char green = fb->colorBuffer[index + 1];
-            unsigned char blue = fb->colorBuffer[index + 2];
-            screenBits[index] = blue;
-            screenBits[index + 1] = green;
-            screenBits[index + 2] = red;
-        }
-    }
+    flush(frontBuffer);
 }
 
-void convertToScreen(int height, int &sx, int &sy) {
+void convertToScreen(int height, int &sy) {
     sy = height - 1 - sy;
 }
 
 void drawPixel(FrameBuffer *fb, int x, int y,
                unsigned char r, unsigned char g, unsigned char b) {
-    convertToScreen(fb->height, x, y);
-    int index = (y * fb->width + x) * 3;
-    fb->colorBuffer[index] = r;
-    fb->colorBuffer[index + 1] = g;
-    fb->colorBuffer[index + 2] = b;
+    convertToScreen(fb->height, y);
+    storePixel(fb, x, y, r, g, b);
 }
 
 void readFrameBuffer(FrameBuffer *fb, int x, int y,
                      unsigned char &r, unsigned char &g, unsigned char &b) {
-    convertToScreen(fb->height, x, y);
-    int index = (y * fb->width + x) * 3;
-    r = fb->colorBuffer[index];
-    g = fb->colorBuffer[index + 1];
-    b = fb->colorBuffer[index + 2];
+    convertToScreen(fb->height, y);
+    loadPixel(fb, x, y, r, g, b);
 }
 
-void writeDepth(DepthBuffer *db, int x, int y, float depth) {
-    convertToScreen(db->height, x, y);
-    db->depthBuffer[y * db->width + x] = depth;
+template<int Format>
+void writeDepth(DepthBuffer *db, int index, float depth) {
+    typedef DepthTraits<Format> Depth;
+    ((typename Depth::Stored *) db->depthBuffer)[index] = Depth::store(depth);
+}
+
+template<int Format>
+float readDepth(const DepthBuffer *db, int index) {
+    typedef DepthTraits<Format> Depth;
+    return Depth::load(((typename Depth::Stored *) db->depthBuffer)[index]);
 }
 
-float readDepth(DepthBuffer *db, int x, int y) {
-    convertToScreen(db->height, x, y);
-    return db->depthBuffer[y * db->width + x];
+void writeDepth(DepthBuffer *db, int x, int y, float depth) {
+    convertToScreen(db->height, y);
+    int index = depthIndex(db, x, y) * db->samples;
+    switch (db->format) {
+        case DEPTH_UNORM16:
+            writeDepth<DEPTH_UNORM16>(db, index, depth);
+            break;
+        case DEPTH_FIXED24:
+            writeDepth<DEPTH_FIXED24>(db, index, depth);
+            break;
+        case DEPTH_FLOAT32_REV:
+            writeDepth<DEPTH_FLOAT32_REV>(db, index, depth);
+            break;
+        default:
+            writeDepth<DEPTH_FLOAT32>(db, index, depth);
+            break;
+    }
 }
 
-void scaleColor(const Vec3& color, unsigned char &iRed, unsigned char &iGreen, unsigned char &iBlue) {
-    const auto scaled = color * 255.0f;
-    iRed = min(255, int(scaled.GetX()));
-    iGreen = min(255, int(scaled.GetY()));
-    iBlue = min(255, int(scaled.GetZ()));
+float readDepth(const DepthBuffer *db, int x, int y) {
+    convertToScreen(db->height, y);
+    int index = depthIndex(db, x, y) * db->samples;
+    switch (db->format) {
+        case DEPTH_UNORM16:
+            return readDepth<DEPTH_UNORM16>(db, index);
+        case DEPTH_FIXED24:
+            return readDepth<DEPTH_FIXED24>(db, index);
+        case DEPTH_FLOAT32_REV:
+            return readDepth<DEPTH_FLOAT32_REV>(db, index);
+        default:
+            return readDepth<DEPTH_FLOAT32>(db, index);
+    }
 }
 
 void viewPortTransform(float ndcX, float ndcY, float width, float height,
@@ -202,18 +520,6 @@ void invViewPortTransform(int screenX, int screenY, float width, float height,
     ndcY = scaleY * 2.0 - 1.0;
 }
 
-void blend(unsigned char srcR, unsigned char srcG, unsigned char srcB, float srcA,
-           unsigned char dstR, unsigned char dstG, unsigned char dstB,
-           unsigned char &finalR, unsigned char &finalG, unsigned char &finalB) {
-    float dstA = 1.0 - srcA;
-    float finR = (float) srcR * srcA + (float) dstR * dstA;
-    float finG = (float) srcG * srcA + (float) dstG * dstA;
-    float finB = (float) srcB * srcA + (float) dstB * dstA;
-    finalR = finR > 255 ? 255 : finR;
-    finalG = finG > 255 ? 255 : finG;
-    finalB = finB > 255 ? 255 : finB;
-}
-
 void calcBounds(float scrAX, float scrAY, float scrBX, float scrBY, float scrCX, float scrCY,
                 float scrY, float &x1, float &x2) {
     if (scrAY == scrBY) {
@@ -259,80 +565,212 @@ void calcBounds(float scrAX, float scrAY, float scrBX, float scrBY, float scrCX,
     }
 }
 
-auto GetUnits(float width, float height, const Face &face) noexcept {
-    float baseX, baseY, oX, oY;
-    invViewPortTransform(0, 0, width, height, baseX, baseY);
-    invViewPortTransform(1, 1, width, height, oX, oY);
-    Vec4 x = face.clipMatrixInv * Vec4{oX - baseX, 0, 0, 0}; // proportion 4D
-    Vec4 y = face.clipMatrixInv * Vec4{0, oY - baseY, 0, 0}; // proportion 4D
-    Vec4 z = face.clipMatrixInv * Vec4{baseX, baseY, 1, 0}; // proportion 4D
-    return std::array<Vec3, 3> { x.Trim(), y.Trim(), z.Trim() };
+// rotated grid sample positions relative to the pixel center
+const float sampleOffsets[MSAA_SAMPLES][2] = {
+        {-0.125f, -0.375f}, {0.375f, -0.125f}, {0.125f, 0.375f}, {-0.375f, 0.125f}
+};
+
+// x range of the triangle inside the slab y0..y1, y0 and y1 clamped to the triangle
+void calcSlabBounds(float scrAX, float scrAY, float scrBX, float scrBY, float scrCX, float scrCY,
+                    float y0, float y1, float &x1, float &x2) {
+    float a1, a2, b1, b2;
+    calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, y0, a1, a2);
+    calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, y1, b1, b2);
+    x1 = min(min(a1, a2), min(b1, b2));
+    x2 = max(max(a1, a2), max(b1, b2));
+    // a vertex inside the slab is the widest point on its side
+    const float vx[3] = {scrAX, scrBX, scrCX};
+    const float vy[3] = {scrAY, scrBY, scrCY};
+    for (int i = 0; i < 3; i++) {
+        if (vy[i] > y0 && vy[i] < y1) {
+            x1 = min(x1, vx[i]);
+            x2 = max(x2, vx[i]);
+        }
+    }
 }
 
-void rasterize2(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, const Face *face) {
-    float ndcX = 0, ndcY = 0;
+// average of 4 packed colors, two channels per 32 bit add
+inline unsigned int averageSamples(const unsigned int *colors) {
+    unsigned int lo = 0x00020002, hi = 0x00020002;
+    for (int s = 0; s < MSAA_SAMPLES; s++) {
+        lo += colors[s] & 0x00ff00ff;
+        hi += (colors[s] >> 8) & 0x00ff00ff;
+    }
+    return ((lo >> 2) & 0x00ff00ff) | (((hi >> 2) & 0x00ff00ff) << 8);
+}
+
+// Coverage and depth are tested at MSAA_SAMPLES positions, the fragment shader
+// runs once per covered pixel. A pixel keeps one color in colorBuffer until a
+// triangle covers it partially, then it is expanded to per sample colors.
+template<int DepthFormat>
+void rasterizeMultisample(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, const Face *face) {
+    typedef DepthTraits<DepthFormat> Depth;
+    // depth only passes may come without a color target
+    int width = fb != nullptr ? fb->width : db->width;
+    int height = fb != nullptr ? fb->height : db->height;
     float scrAX, scrAY, scrBX, scrBY, scrCX, scrCY;
-    viewPortTransform(face->ndcA.x, face->ndcA.y, fb->width, fb->height, scrAX, scrAY);
-    viewPortTransform(face->ndcB.x, face->ndcB.y, fb->width, fb->height, scrBX, scrBY);
-    viewPortTransform(face->ndcC.x, face->ndcC.y, fb->width, fb->height, scrCX, scrCY);
+    viewPortTransform(face->ndcA.x, face->ndcA.y, width, height, scrAX, scrAY);
+    viewPortTransform(face->ndcB.x, face->ndcB.y, width, height, scrBX, scrBY);
+    viewPortTransform(face->ndcC.x, face->ndcC.y, width, height, scrCX, scrCY);
     if (scrAY == scrBY && scrAY == scrCY) return;
-    int minY = max(0, min(scrAY, min(scrBY, scrCY)));
-    int maxY = min(fb->height - 1, max(scrAY, max(scrBY, scrCY)));
-    auto&& [uX, uY, uB] = GetUnits(fb->width, fb->height, *face);
+    float triMinX = min(scrAX, min(scrBX, scrCX)), triMaxX = max(scrAX, max(scrBX, scrCX));
+    float triMinY = min(scrAY, min(scrBY, scrCY)), triMaxY = max(scrAY, max(scrBY, scrCY));
+    const float reach = 0.375f; //farthest sample from the center
+    int minY = max(0, (int) ceilf(triMinY - reach));
+    int maxY = min(height - 1, (int) floorf(triMaxY + reach));
+    int clipMinX = 0, clipMaxX = width - 1;
+    if (scissorFlag) {
+        minY = max(minY, scissorRect.minY);
+        maxY = min(maxY, scissorRect.maxY);
+        clipMinX = max(clipMinX, scissorRect.minX);
+        clipMaxX = min(clipMaxX, scissorRect.maxX);
+    }
+
+    Vec3 uX, uY, uB;
+    getUnits(width, height, *face, uX, uY, uB);
+    Vec3 sampleSteps[MSAA_SAMPLES];
+    for (int s = 0; s < MSAA_SAMPLES; s++)
+        sampleSteps[s] = uX * sampleOffsets[s][0] + uY * sampleOffsets[s][1];
+    const auto& cA = face->clipA;
+    const auto& cB = face->clipB;
+    const auto& cC = face->clipC;
+    const Vec3 clipZ(cA.Clip.GetZ(), cB.Clip.GetZ(), cC.Clip.GetZ());
+    const Vec3 clipW(cA.Clip.GetW(), cB.Clip.GetW(), cC.Clip.GetW());
+    typename Depth::Stored *depths = db != nullptr ? (typename Depth::Stored *) db->depthBuffer : nullptr;
+
     auto baseY = uB + uY * float(minY);
     for (int scrY = minY; scrY <= maxY; (baseY += uY, scrY++)) {
         float x1, x2;
-        calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, (float) scrY, x1, x2);
-        int minX = max(0, roundf(min(x1, x2)));
-        int maxX = min(fb->width - 1, roundf(max(x1, x2)));
-        auto pFrag0 = baseY + uX * float(minX); // proportion fragment
+        calcSlabBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY,
+                       max(triMinY, scrY - reach), min(triMaxY, scrY + reach), x1, x2);
+        int minX = max(clipMinX, (int) ceilf(max(x1, triMinX) - reach));
+        int maxX = min(clipMaxX, (int) floorf(min(x2, triMaxX) + reach));
+        int row = height - 1 - scrY;
+        auto pFrag0 = baseY + uX * float(minX);
         for (int scrX = minX; scrX <= maxX; (pFrag0 += uX, scrX++)) {
-            if (pFrag0.Sse().sign_bits()) continue;
-            float sum = pFrag0.GetX() + pFrag0.GetY() + pFrag0.GetZ();
-            const auto pFrag = pFrag0 * (1.0f / sum);
-
-            const auto& cA = face->clipA;
-            const auto& cB = face->clipB;
-            const auto& cC = face->clipC;
-            // NDC Check
+            int depthBase = db != nullptr ? depthIndex(db, scrX, row) * MSAA_SAMPLES : 0;
+            int mask = 0, shadeSample = -1;
+            for (int s = 0; s < MSAA_SAMPLES; s++) {
+                const auto pSample = pFrag0 + sampleSteps[s];
+                if (pSample.Sse().sign_bits()) continue;
+                // barycentric scale cancels in z / w
+                float z = pSample.DotProduct(clipZ) / pSample.DotProduct(clipW);
+                if (z < Depth::minZ || z > Depth::maxZ) continue;
+                if (depths != nullptr) {
+                    typename Depth::Stored storeZ = Depth::store(z);
+                    if (!Depth::pass(storeZ, depths[depthBase + s])) continue;
+                    depths[depthBase + s] = storeZ;
+                }
+                mask |= 1 << s;
+                if (shadeSample < 0) shadeSample = s;
+            }
+            if (mask == 0 || fs == nullptr) continue;
+
+            // shade at the center when it is covered, at the first covered sample otherwise
+            auto pShade = pFrag0;
+            if (pFrag0.Sse().sign_bits())
+                pShade = pFrag0 + sampleSteps[shadeSample];
+            float sum = pShade.GetX() + pShade.GetY() + pShade.GetZ();
+            const auto pFrag = pShade * (1.0f / sum);
             const auto ndcRaw = cA.Clip * pFrag.GetX() + cB.Clip * pFrag.GetY() + cC.Clip * pFrag.GetZ();
             const auto ndc = ndcRaw * (1.0f / ndcRaw.GetW());
 
-            if (ndc.GetZ() < -1.0f || ndc.GetZ() > 1.0f) continue;
-
-            // early depth
-            if (db != nullptr) {
-                float storeZ = readDepth(db, scrX, scrY);
-                if (storeZ < ndc.GetZ()) continue;
-                writeDepth(db, scrX, scrY, ndc.GetZ());
-            }
-
             Fragment frag;
-            frag.Ndc = ndc.Trim();
-            frag.World = cA.World * pFrag.GetX() + cB.World * pFrag.GetY() + cC.World * pFrag.GetZ();
-            frag.Normal = cA.Normal * pFrag.GetX() + cB.Normal * pFrag.GetY() + cC.Normal * pFrag.GetZ();
-            frag.s = pFrag.DotProduct({face->clipA.s, face->clipB.s, face->clipC.s});
-            frag.t = pFrag.DotProduct({face->clipA.t, face->clipB.t, face->clipC.t});
-
+            buildFragment<VARYING_ALL, 0>(face, pFrag, ndc, frag);
+            texcoordDerivatives(face, pShade, uX, uY, frag);
             FragmentOut outFrag;
             fs(frag, outFrag);
-            unsigned char cr = 255, cg = 255, cb = 255, sr = 255, sg = 255, sb = 255;
+            unsigned char cr = 255, cg = 255, cb = 255;
             scaleColor(outFrag.Color.Trim(), cr, cg, cb);
-            if (blendFlag) {
-                readFrameBuffer(fb, scrX, scrY, sr, sg, sb);
-                blend(cr, cg, cb, outFrag.Color.GetW(), sr, sg, sb, cr, cg, cb);
+            unsigned int color = packColor(fb->format, cr, cg, cb, outFrag.Color.GetW());
+
+            int pixel = pixelIndex(fb, scrX, row);
+            unsigned int *colors = fb->sampleColors + pixel * MSAA_SAMPLES;
+            if (!fb->sampleExpanded[pixel]) {
+                if (mask == (1 << MSAA_SAMPLES) - 1) {
+                    if (blendState.enable)
+                        color = blendPixel(blendFunc, color, loadPacked(fb, scrX, row));
+                    storePacked(fb, scrX, row, color | 0xff000000u);
+                    continue;
+                }
+                unsigned int single = loadPacked(fb, scrX, row);
+                for (int s = 0; s < MSAA_SAMPLES; s++)
+                    colors[s] = single;
+                fb->sampleExpanded[pixel] = 1;
+            }
+            // all samples at once, the covered ones are kept
+            const __m128i stored = _mm_loadu_si128((const __m128i *) colors);
+            __m128i shaded = _mm_set1_epi32(color | 0xff000000u);
+            if (blendState.enable)
+                shaded = blendFunc(_mm_set1_epi32(color), stored);
+            const __m128i covered = _mm_castps_si128(Sse::laneMask(mask).m128());
+            _mm_storeu_si128((__m128i *) colors, _mm_blendv_epi8(stored, shaded, covered));
+            // covered again by one opaque color, back to a single color
+            if (colors[0] == colors[1] && colors[0] == colors[2] && colors[0] == colors[3]) {
+                storePacked(fb, scrX, row, colors[0]);
+                fb->sampleExpanded[pixel] = 0;
             }
-            drawPixel(fb, scrX, scrY, cr, cg, cb);
         }
     }
 }
 
+// blended draws are not in the depth prepass and keep the regular test in the color pass
+inline bool equalDepthTest(FragmentShader fs) {
+    return depthTestMode == DEPTH_TEST_EQUAL && fs != nullptr && !blendState.enable;
+}
+
+template<int DepthFormat>
+void rasterizeFace(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, const Face *face) {
+    if ((fb != nullptr ? fb->samples : db->samples) > 1)
+        rasterizeMultisample<DepthFormat>(fb, db, fs, face);
+    else if (fs == nullptr)
+        rasterizeSingle<NoShader, DepthFormat, false, false>(fb, db, fs, face);
+    else if (equalDepthTest(fs))
+        rasterizeSingle<PointerShader, DepthFormat, false, true>(fb, db, fs, face);
+    else if (blendState.enable)
+        rasterizeSingle<PointerShader, DepthFormat, true, false>(fb, db, fs, face);
+    else
+        rasterizeSingle<PointerShader, DepthFormat, false, false>(fb, db, fs, face);
+}
+
+void resolveFrameBuffer(FrameBuffer *fb) {
+    if (fb->samples <= 1)
+        return;
+    for (int row = 0; row < fb->height; row++) {
+        for (int x = 0; x < fb->width; x++) {
+            int pixel = pixelIndex(fb, x, row);
+            if (!fb->sampleExpanded[pixel])
+                continue;
+            unsigned char r, g, b;
+            unpackPixel(fb->format, averageSamples(fb->sampleColors + pixel * MSAA_SAMPLES), r, g, b);
+            drawPixel(fb, x, fb->height - 1 - row, r, g, b);
+        }
+    }
+}
+
+void rasterize2(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, const Face *face) {
+    switch (db != nullptr ? db->format : DEPTH_NONE) {
+        case DEPTH_NONE:
+            rasterizeFace<DEPTH_NONE>(fb, db, fs, face);
+            break;
+        case DEPTH_UNORM16:
+            rasterizeFace<DEPTH_UNORM16>(fb, db, fs, face);
+            break;
+        case DEPTH_FIXED24:
+            rasterizeFace<DEPTH_FIXED24>(fb, db, fs, face);
+            break;
+        case DEPTH_FLOAT32_REV:
+            rasterizeFace<DEPTH_FLOAT32_REV>(fb, db, fs, face);
+            break;
+        default:
+            rasterizeFace<DEPTH_FLOAT32>(fb, db, fs, face);
+            break;
+    }
+}
+
 bool cullFace(Face *face, int flag) {
-    Vec3 faceNormal = face->clipA.Normal;
-    Vec3 eyeVec = Vec3(eyeX, eyeY, eyeZ) - face->clipA.World.Trim();
-    if (flag == CULL_NONE) return false;
-    if (flag == CULL_BACK) return eyeVec.DotProduct(faceNormal) <= 0;
-    if (flag == CULL_FRONT) return eyeVec.DotProduct(faceNormal) >= 0;
+    if (flag == CULL_BACK) return cullFace<CULL_BACK>(face);
+    if (flag == CULL_FRONT) return cullFace<CULL_FRONT>(face);
     return false;
 }
 
@@ -346,18 +784,14 @@ void drawFace(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader
     if (clipFlag != 0b111) {
         if (clipFlag == 0b000)
             return;
-        fixFaces(face, clipFlag);
-        if (!cullFace(nFace1, cullFlag)) {
-            nFace1->calculateClipMatrixInv();
-            nFace1->calculateNDCVertex();
-            rasterize2(fb, db, fs, nFace1);
-        }
-        if (clipFlag == 0b011 || clipFlag == 0b101 || clipFlag == 0b110) {
-            if (!cullFace(nFace2, cullFlag)) {
-                nFace2->calculateClipMatrixInv();
-                nFace2->calculateNDCVertex();
-                rasterize2(fb, db, fs, nFace2);
-            }
+        Face *clipped[2];
+        int clippedNum = fixFaces(face, clipFlag, clipped);
+        for (int i = 0; i < clippedNum; i++) {
+            if (cullFace(clipped[i], cullFlag))
+                continue;
+            clipped[i]->calculateClipMatrixInv();
+            clipped[i]->calculateNDCVertex();
+            rasterize2(fb, db, fs, clipped[i]);
         }
     } else if (clipFlag == 0b111) {
         face->calculateClipMatrixInv();
@@ -366,11 +800,61 @@ void drawFace(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader
     }
 }
 
-void drawFaces(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader fs, int cullFlag, Vertex *buffer,
+DrawVariant *addShaderVariants(FragmentShader fs) {
+    for (int i = 0; i < shaderVariantNum; i++) {
+        if (shaderVariants[i].fs == fs)
+            return nullptr;
+    }
+    if (shaderVariantNum == MAX_SHADER_VARIANTS)
+        return nullptr;
+    ShaderVariants &entry = shaderVariants[shaderVariantNum++];
+    entry.fs = fs;
+    for (int i = 0; i < VARIANT_COUNT; i++)
+        entry.variants[i] = nullptr;
+    return entry.variants;
+}
+
+void initRasterVariants() {
+    shaderVariantNum = 0;
+    fillVariants<NoShader>(addShaderVariants(nullptr));
+}
+
+DrawVariant findDrawVariant(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, int cullFlag) {
+    if (!rasterVariantFlag || cullFlag < CULL_BACK || cullFlag > CULL_NONE)
+        return nullptr;
+    if ((fb != nullptr ? fb->samples : db->samples) > 1)
+        return nullptr;
+    for (int i = 0; i < shaderVariantNum; i++) {
+        if (shaderVariants[i].fs == fs) {
+            int depthFormat = db != nullptr ? db->format : DEPTH_NONE;
+            bool blend = blendState.enable && fs != nullptr;
+            return shaderVariants[i].variants[variantIndex(depthFormat, blend, equalDepthTest(fs), cullFlag)];
+        }
+    }
+    return nullptr;
+}
+
+void drawFaces(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader fs, int cullFlag, const Vertex *buffer,
                int count) {
+    if (depthPrepass) {
+        if (blendState.enable)
+            return;
+        fs = nullptr;
+        if (prepassVertShader != nullptr)
+            vs = prepassVertShader;
+    }
+    blendFunc = blendState.enable ? resolveBlend(blendState) : nullptr;
+    // depth only passes read nothing but the vertex positions
+    if (uniformUpdate != nullptr && fs != nullptr)
+        uniformUpdate();
+    DrawVariant variant = findDrawVariant(fb, db, fs, cullFlag);
+    if (variant != nullptr) {
+        variant(fb, db, vs, buffer, count);
+        return;
+    }
     for (int i = 0; i < count; i++) {
-        Face face(buffer[i * 3], buffer[i * 3 + 1], buffer[i * 3 + 2]);
-        drawFace(fb, db, vs, fs, cullFlag, &face);
+        Face *face = frameArena->create<Face>(buffer[i * 3], buffer[i * 3 + 1], buffer[i * 3 + 2]);
+        drawFace(fb, db, vs, fs, cullFlag, face);
     }
 }
 
@@ -382,40 +866,81 @@ int checkFace(Face *face) {
     return flags;
 }
 
-void initFixFace() {
-    nFace1 = new Face();
-    nFace2 = new Face();
+void initFrameArena() {
+    frameArena = new Arena();
+}
+
+void releaseFrameArena() {
+    delete frameArena;
+    frameArena = nullptr;
 }
 
-void releaseFixFace() {
-    delete nFace1;
-    delete nFace2;
+void resetFrameArena() {
+    frameArena->reset();
+    if (arenaStatsFlag)
+        printf("frame arena: %zu bytes peak, %zu bytes max, %d blocks\n",
+               frameArena->lastPeak, frameArena->maxPeak, frameArena->getBlockNum());
 }
 
-void fixFaces(Face *face, int fixFlag) {
+// flat varyings of the provoking vertex
+void copyFlat(const VertexOut &provoking, VertexOut &v, int flat) {
+    if (flat & VARYING_WORLD)
+        v.World = provoking.World;
+    if (flat & VARYING_LIGHT)
+        v.Light = provoking.Light;
+    if (flat & VARYING_NORMAL)
+        v.Normal = provoking.Normal;
+    if (flat & VARYING_TEXCOORD) {
+        v.s = provoking.s;
+        v.t = provoking.t;
+    }
+}
+
+int fixFaces(Face *face, int fixFlag, Face **clipped, int varyings, int flat) {
+    int clippedNum;
     switch (fixFlag) {
-        case 0b011:return fix1FailFace(face->clipA, face->clipB, face->clipC);
-        case 0b101:return fix1FailFace(face->clipB, face->clipA, face->clipC);
-        case 0b110:return fix1FailFace(face->clipC, face->clipA, face->clipB);
-        case 0b001:return fix2FailFace(face->clipA, face->clipB, face->clipC);
-        case 0b010:return fix2FailFace(face->clipA, face->clipC, face->clipB);
-        case 0b100:return fix2FailFace(face->clipB, face->clipC, face->clipA);
-        default: return;
+        case 0b011:fix1FailFace(face->clipA, face->clipB, face->clipC, clipped, varyings, flat); clippedNum = 2; break;
+        case 0b101:fix1FailFace(face->clipB, face->clipA, face->clipC, clipped, varyings, flat); clippedNum = 2; break;
+        case 0b110:fix1FailFace(face->clipC, face->clipA, face->clipB, clipped, varyings, flat); clippedNum = 2; break;
+        case 0b001:fix2FailFace(face->clipA, face->clipB, face->clipC, clipped, varyings, flat); clippedNum = 1; break;
+        case 0b010:fix2FailFace(face->clipA, face->clipC, face->clipB, clipped, varyings, flat); clippedNum = 1; break;
+        case 0b100:fix2FailFace(face->clipB, face->clipC, face->clipA, clipped, varyings, flat); clippedNum = 1; break;
+        default: return 0;
+    }
+    // clipping reorders the vertices, the raster loops read flat varyings from clipA
+    if (flat != 0) {
+        for (int i = 0; i < clippedNum; i++)
+            copyFlat(face->clipA, clipped[i]->clipA, flat);
     }
+    return clippedNum;
 }
 
 void interpolate2v(float pa, float pb,
                    const VertexOut& a, const VertexOut& b,
-                   VertexOut &result) {
+                   VertexOut &result, int varyings, int flat) {
     result.Clip = a.Clip * pa + b.Clip * pb;
-    result.World = a.World * pa + b.World * pb;
     result.View = a.View * pa + b.View * pb;
-    result.Normal = a.Normal * pa + b.Normal * pb;
-    interpolate2f(pa, pb, a.s, b.s, result.s);
-    interpolate2f(pa, pb, a.t, b.t, result.t);
+    if (varyings & VARYING_WORLD)
+        result.World = (flat & VARYING_WORLD) ? a.World : a.World * pa + b.World * pb;
+    if (varyings & VARYING_LIGHT)
+        result.Light = (flat & VARYING_LIGHT) ? a.Light : a.Light * pa + b.Light * pb;
+    if (varyings & VARYING_NORMAL)
+        result.Normal = (flat & VARYING_NORMAL) ? a.Normal : a.Normal * pa + b.Normal * pb;
+    if (varyings & VARYING_TEXCOORD) {
+        if (flat & VARYING_TEXCOORD) {
+            result.s = a.s;
+            result.t = a.t;
+        } else {
+            interpolate2f(pa, pb, a.s, b.s, result.s);
+            interpolate2f(pa, pb, a.t, b.t, result.t);
+        }
+    }
 }
 
-void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut& succ2) {
+void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut& succ2, Face **clipped,
+                  int varyings, int flat) {
+    Face *face1 = frameArena->create<Face>();
+    Face *face2 = frameArena->create<Face>();
     float z = -clipNear;
     Vec3 pFail = fail.View.Trim() * (1.0f / fail.View.GetW());
     Vec3 pSucc1 = succ1.View.Trim() * (1.0f / succ1.View.GetW());
@@ -428,8 +953,8 @@ void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut
     float invSum = 1.0 / sum;
     sp *= invSum;
     fp *= invSum;
-    VertexOut inter1;
-    interpolate2v(sp, fp, succ1, fail, inter1);
+    face1->clipA = succ1;
+    interpolate2v(sp, fp, succ1, fail, face1->clipB, varyings, flat);
 
     float param2 = calcZPara(pFail.z, pSucc2.z, z);
     Vec3 interPoint2 = calcParaEqu(pFail, pSucc2, param2);
@@ -439,14 +964,16 @@ void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut
     invSum = 1.0 / sum;
     sp *= invSum;
     fp *= invSum;
-    VertexOut inter2;
-    interpolate2v(sp, fp, succ2, fail, inter2);
+    interpolate2v(sp, fp, succ2, fail, face1->clipC, varyings, flat);
 
-    nFace1->copy2FaceOut(succ1, inter1, inter2);
-    nFace2->copy2FaceOut(succ2, succ1, inter2);
+    face2->copy2FaceOut(succ2, succ1, face1->clipC);
+    clipped[0] = face1;
+    clipped[1] = face2;
 }
 
-void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOut& succ) {
+void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOut& succ, Face **clipped,
+                  int varyings, int flat) {
+    Face *face1 = frameArena->create<Face>();
     float z = -clipNear;
     Vec3 pFail1 = fail1.View.Trim() * (1.0f / fail1.View.GetW());
     Vec3 pFail2 = fail2.View.Trim() * (1.0f / fail2.View.GetW());
@@ -459,8 +986,8 @@ void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOu
     float invSum = 1.0 / sum;
     sp *= invSum;
     fp *= invSum;
-    VertexOut inter1;
-    interpolate2v(sp, fp, succ, fail1, inter1);
+    face1->clipA = succ;
+    interpolate2v(sp, fp, succ, fail1, face1->clipB, varyings, flat);
 
     float param2 = calcZPara(pFail2.z, pSucc.z, z);
     Vec3 interPoint2 = calcParaEqu(pFail2, pSucc, param2);
@@ -470,8 +997,6 @@ void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOu
     invSum = 1.0 / sum;
     sp *= invSum;
     fp *= invSum;
-    VertexOut inter2;
-    interpolate2v(sp, fp, succ, fail2, inter2);
-
-    nFace1->copy2FaceOut(succ, inter1, inter2);
+    interpolate2v(sp, fp, succ, fail2, face1->clipC, varyings, flat);
+    clipped[0] = face1;
 }
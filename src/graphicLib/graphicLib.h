@@ -3,34 +3,89 @@
 
 #include "../header/header.h"
 #include "../face/face.h"
-
-extern float eyeX, eyeY, eyeZ, clipNear;
-extern Face *nFace1;
-extern Face *nFace2;
-extern bool blendFlag;
-
-extern FrameBuffer *frontBuffer;
-extern FrameBuffer *backBuffer;
-
-extern FrameBuffer *frameBuffer1;
-extern FrameBuffer *frameBuffer2;
-extern DepthBuffer *depthBuffer;
-
-extern unsigned char *screenBits;
-
-void initFrameBuffer(FrameBuffer **pfb, int width, int height);
+#include "../presenter/presenter.h"
+#include "../arena/arena.h"
+#include "targetAlloc.h"
+#include "blendState.h"
+
+extern RENDER_LOCAL float eyeX, eyeY, eyeZ, clipNear;
+extern RENDER_LOCAL Arena *frameArena;
+extern RENDER_LOCAL bool arenaStatsFlag;
+extern RENDER_LOCAL BlendState blendState;
+// blendState resolved by drawFaces for the raster loops of the draw
+extern RENDER_LOCAL BlendFunc blendFunc;
+// called once per drawFaces with a fragment shader before any vertex is shaded, derives
+// the per draw uniforms. Depth only draws, the shadow map and the prepass, skip it.
+extern RENDER_LOCAL DrawCall uniformUpdate;
+// drawFaces takes the compile time specialized loops of registered shaders, see rasterVariant.h
+extern RENDER_LOCAL bool rasterVariantFlag;
+// DEPTH_TEST_LESS or DEPTH_TEST_EQUAL, single sampled opaque draws only, blended ones keep the less test
+extern RENDER_LOCAL int depthTestMode;
+// Second color target of the draws, written opaque with FragmentOut::Color1 next to the
+// target of drawFaces by the single sampled loops. Same size and layout, nullptr for none.
+extern RENDER_LOCAL FrameBuffer *secondTarget;
+// drawFaces rasterizes depth only with prepassVertShader (when set) and skips blended draws
+extern RENDER_LOCAL bool depthPrepass;
+extern RENDER_LOCAL VertexShader prepassVertShader;
+// fragments passing the depth test so far, counted by the single sampled loops
+extern RENDER_LOCAL long long rasterFragments;
+extern RENDER_LOCAL bool scissorFlag;
+extern RENDER_LOCAL Rect scissorRect;
+
+extern RENDER_LOCAL FrameBuffer *frontBuffer;
+extern RENDER_LOCAL FrameBuffer *backBuffer;
+
+extern RENDER_LOCAL FrameBuffer *frameBuffer1;
+extern RENDER_LOCAL FrameBuffer *frameBuffer2;
+extern RENDER_LOCAL DepthBuffer *depthBuffer;
+extern RENDER_LOCAL int framePixelFormat;
+extern RENDER_LOCAL int frameLayout;
+extern RENDER_LOCAL int frameDepthFormat;
+extern RENDER_LOCAL int frameSamples;
+
+extern RENDER_LOCAL Presenter *presenter;
+
+// tiles covering width x height, 0 for LAYOUT_LINEAR
+void calcTiles(int layout, int width, int height, int &tilesX, int &tilesY);
+
+// elements allocated for a buffer, tiled buffers are padded to whole tiles
+int bufferElements(int layout, int width, int height, int tilesX, int tilesY);
+
+void initFrameBuffer(FrameBuffer **pfb, int width, int height, int format = PIXEL_BGRA8,
+                     int layout = LAYOUT_LINEAR);
+
+void initFrameBufferSurface(FrameBuffer **pfb, unsigned char *pixels, int width, int height, int stride, int format);
+
+// resizes reuse the allocation within its capacity, see targetPolicy
+void resizeFrameBuffer(FrameBuffer *fb, int width, int height, int format, int layout);
+
+void attachFrameBufferSurface(FrameBuffer *fb, unsigned char *pixels, int width, int height, int stride, int format);
+
+// 1 or MSAA_SAMPLES, multisampled buffers need a depth buffer with the same samples
+void setFrameBufferSamples(FrameBuffer *fb, int samples);
 
 void releaseFrameBuffer(FrameBuffer **pfb);
 
-void initDepthBuffer(DepthBuffer **pdb, int width, int height);
+void initDepthBuffer(DepthBuffer **pdb, int width, int height, int layout = LAYOUT_LINEAR,
+                     int format = DEPTH_FLOAT32, int samples = 1);
+
+void resizeDepthBuffer(DepthBuffer *db, int width, int height, int layout, int format, int samples = 1);
 
 void releaseDepthBuffer(DepthBuffer **pdb);
 
-void initDevice(FrameBuffer **pfb, DepthBuffer **pdb, int width, int height);
+void initDevice(FrameBuffer **pfb, DepthBuffer **pdb, int width, int height, int format = PIXEL_BGRA8,
+                int layout = LAYOUT_LINEAR, int depthFormat = DEPTH_FLOAT32);
 
 void releaseDevice(FrameBuffer **pfb, DepthBuffer **pdb);
 
-void initDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height);
+void initDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height,
+                    int format = PIXEL_BGRA8, int layout = LAYOUT_LINEAR, int depthFormat = DEPTH_FLOAT32,
+                    int samples = 1);
+
+// keeps the buffers of an earlier initDevice2Buf, only grows them when needed
+void resizeDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb, int width, int height,
+                      int format = PIXEL_BGRA8, int layout = LAYOUT_LINEAR, int depthFormat = DEPTH_FLOAT32,
+                      int samples = 1);
 
 void releaseDevice2Buf(FrameBuffer **pfb1, FrameBuffer **pfb2, DepthBuffer **pdb);
 
@@ -40,6 +95,23 @@ void clearScreenFast(FrameBuffer *fb, unsigned char color);
 
 void clearDepth(DepthBuffer *db);
 
+void clearScreenRect(FrameBuffer *fb, const Rect &rect, unsigned char red, unsigned char green, unsigned char blue);
+
+void clearDepthRect(DepthBuffer *db, const Rect &rect);
+
+Rect unionRect(const Rect &a, const Rect &b);
+
+Rect intersectRect(const Rect &a, const Rect &b);
+
+// row of pixels in linear order and fb->format, detiles tiled buffers
+void readFrameBufferRow(const FrameBuffer *fb, int row, int minX, int maxX, unsigned char *dst);
+
+// the whole image in linear order for tiled buffers of 4 byte formats, walked tile by tile
+void readFrameBufferTiles(const FrameBuffer *fb, unsigned char *dst, int dstStride);
+
+// averages the samples of expanded pixels into colorBuffer, nothing to do for 1 sample
+void resolveFrameBuffer(FrameBuffer *fb);
+
 void flush(FrameBuffer *fb);
 
 void swapBuffer();
@@ -55,17 +127,17 @@ void viewPortTransform(float ndcX, float ndcY, float width, float height,
 void rasterize2(FrameBuffer *fb, DepthBuffer *db,
                 FragmentShader fs, const Face *face);
 
-void blend(unsigned char srcR, unsigned char srcG, unsigned char srcB, float srcA,
-           unsigned char dstR, unsigned char dstG, unsigned char dstB,
-           unsigned char &finalR, unsigned char &finalG, unsigned char &finalB);
+// registers the depth only variants, shaders add theirs with registerShaderVariants
+void initRasterVariants();
 
 void drawFace(FrameBuffer *fb, DepthBuffer *db,
               VertexShader vs, FragmentShader fs, int cullFlag,
               Face *face);
 
+// fs == nullptr rasterizes depth only, fb may be nullptr then
 void drawFaces(FrameBuffer *fb, DepthBuffer *db,
                VertexShader vs, FragmentShader fs, int cullFlag,
-               Vertex *buffer, int count);
+               const Vertex *buffer, int count);
 
 void drawPixel(FrameBuffer *fb, int x, int y,
                unsigned char r, unsigned char g, unsigned char b);
@@ -75,25 +147,33 @@ void readFrameBuffer(FrameBuffer *fb, int x, int y,
 
 void writeDepth(DepthBuffer *db, int x, int y, float depth);
 
-float readDepth(DepthBuffer *db, int x, int y);
+float readDepth(const DepthBuffer *db, int x, int y);
 
 void invViewPortTransform(int screenX, int screenY, float width, float height,
                           float &ndcX, float &ndcY);
 
-void initFixFace();
+void initFrameArena();
+
+void releaseFrameArena();
 
-void releaseFixFace();
+// frees everything allocated from frameArena during the frame, prints the peak with arenaStatsFlag
+void resetFrameArena();
 
 int checkFace(Face *face);
 
-void fixFaces(Face *face, int fixFlag);
+// faces clipped against the near plane are allocated from frameArena, returns their count.
+// Only the VARYING_* in varyings are carried over. Flat ones are those of the provoking vertex,
+// clipA of face, and end up in clipA of every clipped face.
+int fixFaces(Face *face, int fixFlag, Face **clipped, int varyings = VARYING_ALL, int flat = 0);
 
-void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut& succ2);
+void fix1FailFace(const VertexOut& fail, const VertexOut& succ1, const VertexOut& succ2, Face **clipped,
+                  int varyings, int flat);
 
-void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOut& succ);
+void fix2FailFace(const VertexOut& fail1, const VertexOut& fail2, const VertexOut& succ, Face **clipped,
+                  int varyings, int flat);
 
 void interpolate2v(float pa, float pb,
                    const VertexOut& a, const VertexOut& b,
-                   VertexOut &result);
+                   VertexOut &result, int varyings = VARYING_ALL, int flat = 0);
 
 #endif /* GRAPHICLIB_H_ */
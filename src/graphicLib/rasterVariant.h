@@ -0,0 +1,557 @@
+#ifndef RASTERVARIANT_H_
+#define RASTERVARIANT_H_
+
+#include "graphicLib.h"
+#include "depthFormat.h"
+
+// Raster loops specialized at compile time on shader, depth format, blending
+// and culling. A shader type provides depthOnly, packet, twoTargets (whether it
+// may write secondTarget), the VARYING_* it reads (varyings, flat) and a static
+// shade or shadePacket, the runtime fs is only passed on for PointerShader.
+
+struct PointerShader {
+    static constexpr bool depthOnly = false;
+    static constexpr bool packet = false;
+    static constexpr bool twoTargets = true;
+    static constexpr int varyings = VARYING_ALL, flat = 0;
+
+    static void shade(FragmentShader fs, const Fragment &input, FragmentOut &output) noexcept {
+        fs(input, output);
+    }
+};
+
+// Fs is known here, instantiated where its definition is visible it is inlined into the loop
+template<FragmentShader Fs, int Varyings, int Flat, bool TwoTargets>
+struct StaticShader {
+    static constexpr bool depthOnly = false;
+    static constexpr bool packet = false;
+    static constexpr bool twoTargets = TwoTargets;
+    static constexpr int varyings = Varyings, flat = Flat;
+
+    static void shade(FragmentShader, const Fragment &input, FragmentOut &output) noexcept {
+        Fs(input, output);
+    }
+};
+
+struct NoShader {
+    static constexpr bool depthOnly = true;
+    static constexpr bool packet = false;
+    static constexpr bool twoTargets = false;
+    static constexpr int varyings = 0, flat = 0;
+
+    static void shade(FragmentShader, const Fragment &, FragmentOut &) noexcept {}
+};
+
+template<PacketShader Ps, int Varyings, int Flat>
+struct StaticPacketShader {
+    static constexpr bool depthOnly = false;
+    static constexpr bool packet = true;
+    static constexpr bool twoTargets = false;
+    static constexpr int varyings = Varyings, flat = Flat;
+
+    static void shadePacket(const FragmentPacket &input, FragmentPacketOut &output) noexcept {
+        Ps(input, output);
+    }
+};
+
+void calcBounds(float scrAX, float scrAY, float scrBX, float scrBY, float scrCX, float scrCY,
+                float scrY, float &x1, float &x2);
+
+// barycentric steps per pixel in x and y and the value at pixel (0, 0), not yet divided by their sum
+inline void getUnits(float width, float height, const Face &face, Vec3 &uX, Vec3 &uY, Vec3 &uB) noexcept {
+    float baseX, baseY, oX, oY;
+    invViewPortTransform(0, 0, width, height, baseX, baseY);
+    invViewPortTransform(1, 1, width, height, oX, oY);
+    uX = (face.clipMatrixInv * Vec4{oX - baseX, 0, 0, 0}).Trim(); // proportion 4D
+    uY = (face.clipMatrixInv * Vec4{0, oY - baseY, 0, 0}).Trim(); // proportion 4D
+    uB = (face.clipMatrixInv * Vec4{baseX, baseY, 1, 0}).Trim(); // proportion 4D
+}
+
+template<bool Flat, class T>
+inline T interpolateVarying(const T &a, const T &b, const T &c, const Vec3 &pFrag) {
+    if constexpr (Flat)
+        return a;
+    else
+        return a * pFrag.GetX() + b * pFrag.GetY() + c * pFrag.GetZ();
+}
+
+// fills the VARYING_* in Varyings, the other fields keep their defaults
+template<int Varyings, int Flat>
+inline void buildFragment(const Face *face, const Vec3 &pFrag, const Vec4 &ndc, Fragment &frag) {
+    const auto& cA = face->clipA;
+    const auto& cB = face->clipB;
+    const auto& cC = face->clipC;
+    frag.Ndc = ndc.Trim();
+    if constexpr ((Varyings & VARYING_WORLD) != 0)
+        frag.World = interpolateVarying<(Flat & VARYING_WORLD) != 0>(cA.World, cB.World, cC.World, pFrag);
+    if constexpr ((Varyings & VARYING_LIGHT) != 0)
+        frag.Light = interpolateVarying<(Flat & VARYING_LIGHT) != 0>(cA.Light, cB.Light, cC.Light, pFrag);
+    if constexpr ((Varyings & VARYING_NORMAL) != 0)
+        frag.Normal = interpolateVarying<(Flat & VARYING_NORMAL) != 0>(cA.Normal, cB.Normal, cC.Normal, pFrag);
+    if constexpr ((Varyings & VARYING_TEXCOORD) != 0 && (Flat & VARYING_TEXCOORD) != 0) {
+        frag.s = cA.s;
+        frag.t = cA.t;
+    } else if constexpr ((Varyings & VARYING_TEXCOORD) != 0) {
+        frag.s = pFrag.DotProduct({cA.s, cB.s, cC.s});
+        frag.t = pFrag.DotProduct({cA.t, cB.t, cC.t});
+    }
+}
+
+// s, t of the next pixel in x and y minus the ones of pFrag, pFrag0 not yet divided by its sum
+inline void texcoordDerivatives(const Face *face, const Vec3 &pFrag0, const Vec3 &uX, const Vec3 &uY,
+                                Fragment &frag) {
+    const Vec3 s(face->clipA.s, face->clipB.s, face->clipC.s);
+    const Vec3 t(face->clipA.t, face->clipB.t, face->clipC.t);
+    const auto pNextX = pFrag0 + uX, pNextY = pFrag0 + uY;
+    const auto pX = pNextX * (1.0f / (pNextX.GetX() + pNextX.GetY() + pNextX.GetZ()));
+    const auto pY = pNextY * (1.0f / (pNextY.GetX() + pNextY.GetY() + pNextY.GetZ()));
+    frag.dsdx = pX.DotProduct(s) - frag.s;
+    frag.dtdx = pX.DotProduct(t) - frag.t;
+    frag.dsdy = pY.DotProduct(s) - frag.s;
+    frag.dtdy = pY.DotProduct(t) - frag.t;
+}
+
+inline void scaleColor(const Vec3& color, unsigned char &iRed, unsigned char &iGreen, unsigned char &iBlue) {
+    const auto scaled = color * 255.0f;
+    iRed = min(255, int(scaled.GetX()));
+    iGreen = min(255, int(scaled.GetY()));
+    iBlue = min(255, int(scaled.GetZ()));
+}
+
+// Single sampled raster loop. DepthFormat fixes the ndc z range and the depth test,
+// DEPTH_NONE clips the conventional -1..1 range without a depth buffer. EqualDepth
+// shades only where a depth prepass left the same depth and writes no depth.
+// Barycentrics are computed per pixel as in rasterizeQuads, so both loops give
+// bit identical depths.
+template<class Shader, int DepthFormat, bool Blend, bool EqualDepth>
+void rasterizeSingle(FrameBuffer *fb, DepthBuffer *db, FragmentShader fs, const Face *face) {
+    typedef DepthTraits<DepthFormat> Depth;
+    // depth only passes may come without a color target
+    int width = fb != nullptr ? fb->width : db->width;
+    int height = fb != nullptr ? fb->height : db->height;
+    float scrAX, scrAY, scrBX, scrBY, scrCX, scrCY;
+    viewPortTransform(face->ndcA.x, face->ndcA.y, width, height, scrAX, scrAY);
+    viewPortTransform(face->ndcB.x, face->ndcB.y, width, height, scrBX, scrBY);
+    viewPortTransform(face->ndcC.x, face->ndcC.y, width, height, scrCX, scrCY);
+    if (scrAY == scrBY && scrAY == scrCY) return;
+    int minY = max(0, min(scrAY, min(scrBY, scrCY)));
+    int maxY = min(height - 1, max(scrAY, max(scrBY, scrCY)));
+    int clipMinX = 0, clipMaxX = width - 1;
+    if (scissorFlag) {
+        minY = max(minY, scissorRect.minY);
+        maxY = min(maxY, scissorRect.maxY);
+        clipMinX = max(clipMinX, scissorRect.minX);
+        clipMaxX = min(clipMaxX, scissorRect.maxX);
+    }
+    Vec3 uX, uY, uB;
+    getUnits(width, height, *face, uX, uY, uB);
+    const auto& cA = face->clipA;
+    const auto& cB = face->clipB;
+    const auto& cC = face->clipC;
+    int passed = 0;
+    const BlendFunc blend = blendFunc;
+    FrameBuffer *const target1 = Shader::twoTargets ? secondTarget : nullptr;
+    for (int scrY = minY; scrY <= maxY; scrY++) {
+        float x1, x2;
+        calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, (float) scrY, x1, x2);
+        int minX = max(clipMinX, roundf(min(x1, x2)));
+        int maxX = min(clipMaxX, roundf(max(x1, x2)));
+        int row = height - 1 - scrY;
+        const auto baseY = uY * float(scrY);
+        for (int scrX = minX; scrX <= maxX; scrX++) {
+            const auto pFrag0 = uB + uX * float(scrX) + baseY; // proportion fragment
+            if (pFrag0.Sse().sign_bits()) continue;
+            float sum = pFrag0.GetX() + pFrag0.GetY() + pFrag0.GetZ();
+            const auto pFrag = pFrag0 * (1.0f / sum);
+
+            // NDC Check
+            const auto ndcRaw = cA.Clip * pFrag.GetX() + cB.Clip * pFrag.GetY() + cC.Clip * pFrag.GetZ();
+            const auto ndc = ndcRaw * (1.0f / ndcRaw.GetW());
+
+            if (ndc.GetZ() < Depth::minZ || ndc.GetZ() > Depth::maxZ) continue;
+
+            // early depth
+            if (DepthFormat != DEPTH_NONE) {
+                typename Depth::Stored *storeZ = (typename Depth::Stored *) db->depthBuffer +
+                                                 depthIndex(db, scrX, row);
+                typename Depth::Stored z = Depth::store(ndc.GetZ());
+                if constexpr (EqualDepth) {
+                    if (!Depth::equal(z, *storeZ)) continue;
+                } else {
+                    if (!Depth::pass(z, *storeZ)) continue;
+                    *storeZ = z;
+                }
+            }
+            passed++;
+            if (Shader::depthOnly) continue;
+
+            Fragment frag;
+            buildFragment<Shader::varyings, Shader::flat>(face, pFrag, ndc, frag);
+            if constexpr ((Shader::varyings & ~Shader::flat & VARYING_TEXCOORD) != 0)
+                texcoordDerivatives(face, pFrag0, uX, uY, frag);
+
+            FragmentOut outFrag;
+            Shader::shade(fs, frag, outFrag);
+            unsigned char cr = 255, cg = 255, cb = 255;
+            scaleColor(outFrag.Color.Trim(), cr, cg, cb);
+            if (Blend) {
+                unsigned int color = packColor(fb->format, cr, cg, cb, outFrag.Color.GetW());
+                storePacked(fb, scrX, row, blendPixel(blend, color, loadPacked(fb, scrX, row)));
+            } else {
+                storePixel(fb, scrX, row, cr, cg, cb);
+            }
+            if (Shader::twoTargets && target1 != nullptr) {
+                scaleColor(outFrag.Color1.Trim(), cr, cg, cb);
+                storePixel(target1, scrX, row, cr, cg, cb);
+            }
+        }
+    }
+    rasterFragments += passed;
+}
+
+// lanes set in a PACKET_SIZE bit mask
+inline int maskLanes(int mask) noexcept {
+    static const unsigned char lanes[1 << PACKET_SIZE] = {0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4};
+    return lanes[mask];
+}
+
+inline Sse::Vec4f interpolateLanes(float a, float b, float c,
+                                   Sse::Vec4f pX, Sse::Vec4f pY, Sse::Vec4f pZ) noexcept {
+    return Sse::Vec4f(a) * pX + Sse::Vec4f(b) * pY + Sse::Vec4f(c) * pZ;
+}
+
+template<bool Flat>
+inline Sse::Vec4f varyingLanes(float a, float b, float c, Sse::Vec4f pX, Sse::Vec4f pY, Sse::Vec4f pZ) noexcept {
+    if constexpr (Flat)
+        return Sse::Vec4f(a);
+    else
+        return interpolateLanes(a, b, c, pX, pY, pZ);
+}
+
+// fills the VARYING_* in Varyings, the other fields are left uninitialized
+template<int Varyings, int Flat>
+inline void buildPacket(const Face *face, Sse::Vec4f pX, Sse::Vec4f pY, Sse::Vec4f pZ, FragmentPacket &packet) {
+    const auto& cA = face->clipA;
+    const auto& cB = face->clipB;
+    const auto& cC = face->clipC;
+    if constexpr ((Varyings & VARYING_WORLD) != 0) {
+        constexpr bool flat = (Flat & VARYING_WORLD) != 0;
+        packet.worldX = varyingLanes<flat>(cA.World.x, cB.World.x, cC.World.x, pX, pY, pZ);
+        packet.worldY = varyingLanes<flat>(cA.World.y, cB.World.y, cC.World.y, pX, pY, pZ);
+        packet.worldZ = varyingLanes<flat>(cA.World.z, cB.World.z, cC.World.z, pX, pY, pZ);
+        packet.worldW = varyingLanes<flat>(cA.World.w, cB.World.w, cC.World.w, pX, pY, pZ);
+    }
+    if constexpr ((Varyings & VARYING_LIGHT) != 0) {
+        constexpr bool flat = (Flat & VARYING_LIGHT) != 0;
+        packet.lightX = varyingLanes<flat>(cA.Light.x, cB.Light.x, cC.Light.x, pX, pY, pZ);
+        packet.lightY = varyingLanes<flat>(cA.Light.y, cB.Light.y, cC.Light.y, pX, pY, pZ);
+        packet.lightZ = varyingLanes<flat>(cA.Light.z, cB.Light.z, cC.Light.z, pX, pY, pZ);
+        packet.lightW = varyingLanes<flat>(cA.Light.w, cB.Light.w, cC.Light.w, pX, pY, pZ);
+    }
+    if constexpr ((Varyings & VARYING_NORMAL) != 0) {
+        constexpr bool flat = (Flat & VARYING_NORMAL) != 0;
+        packet.normalX = varyingLanes<flat>(cA.Normal.x, cB.Normal.x, cC.Normal.x, pX, pY, pZ);
+        packet.normalY = varyingLanes<flat>(cA.Normal.y, cB.Normal.y, cC.Normal.y, pX, pY, pZ);
+        packet.normalZ = varyingLanes<flat>(cA.Normal.z, cB.Normal.z, cC.Normal.z, pX, pY, pZ);
+    }
+    if constexpr ((Varyings & VARYING_TEXCOORD) != 0) {
+        constexpr bool flat = (Flat & VARYING_TEXCOORD) != 0;
+        packet.s = varyingLanes<flat>(cA.s, cB.s, cC.s, pX, pY, pZ);
+        packet.t = varyingLanes<flat>(cA.t, cB.t, cC.t, pX, pY, pZ);
+    }
+}
+
+// Packet raster loop over 2x2 quads. A pixel is covered exactly when rasterizeSingle
+// would cover it: inside the calcBounds span of its row and with no negative barycentric.
+// Linear targets are walked in quad rows aligned to even pixels. Tiled targets are walked
+// tile by tile with quads aligned to even rows of the buffer, each quad is then four
+// consecutive elements of a tile, lanes 0 and 1 being the odd row.
+template<class Shader, int DepthFormat, bool Blend, bool EqualDepth>
+void rasterizeQuads(FrameBuffer *fb, DepthBuffer *db, const Face *face) {
+    using Sse::Vec4f;
+    typedef DepthTraits<DepthFormat> Depth;
+    int width = fb->width;
+    int height = fb->height;
+    float scrAX, scrAY, scrBX, scrBY, scrCX, scrCY;
+    viewPortTransform(face->ndcA.x, face->ndcA.y, width, height, scrAX, scrAY);
+    viewPortTransform(face->ndcB.x, face->ndcB.y, width, height, scrBX, scrBY);
+    viewPortTransform(face->ndcC.x, face->ndcC.y, width, height, scrCX, scrCY);
+    if (scrAY == scrBY && scrAY == scrCY) return;
+    int minY = max(0, min(scrAY, min(scrBY, scrCY)));
+    int maxY = min(height - 1, max(scrAY, max(scrBY, scrCY)));
+    int clipMinX = 0, clipMaxX = width - 1;
+    if (scissorFlag) {
+        minY = max(minY, scissorRect.minY);
+        maxY = min(maxY, scissorRect.maxY);
+        clipMinX = max(clipMinX, scissorRect.minX);
+        clipMaxX = min(clipMaxX, scissorRect.maxX);
+    }
+    Vec3 uX, uY, uB;
+    getUnits(width, height, *face, uX, uY, uB);
+    const auto& cA = face->clipA;
+    const auto& cB = face->clipB;
+    const auto& cC = face->clipC;
+    const Vec4f laneX(0, 1, 0, 1), laneY(0, 0, 1, 1);
+    int passed = 0;
+    const BlendFunc blend = blendFunc;
+
+    // quadIndex is the element of lane 2 in a tiled buffer, -1 for linear addressing
+    auto shadeQuad = [&](int quadX, int quadY, int mask, int quadIndex) {
+        const Vec4f xs = Vec4f(float(quadX)) + laneX;
+        const Vec4f ys = Vec4f(float(quadY)) + laneY;
+        Vec4f pX = Vec4f(uB.x) + Vec4f(uX.x) * xs + Vec4f(uY.x) * ys;
+        Vec4f pY = Vec4f(uB.y) + Vec4f(uX.y) * xs + Vec4f(uY.y) * ys;
+        Vec4f pZ = Vec4f(uB.z) + Vec4f(uX.z) * xs + Vec4f(uY.z) * ys;
+        mask &= ~(pX.sign_bits() | pY.sign_bits() | pZ.sign_bits());
+        if (mask == 0) return;
+        const Vec4f invSum = Vec4f(1.0f) / (pX + pY + pZ);
+        pX = pX * invSum;
+        pY = pY * invSum;
+        pZ = pZ * invSum;
+
+        // NDC Check
+        const Vec4f invW = Vec4f(1.0f) / interpolateLanes(cA.Clip.w, cB.Clip.w, cC.Clip.w, pX, pY, pZ);
+        const Vec4f ndcZ = interpolateLanes(cA.Clip.z, cB.Clip.z, cC.Clip.z, pX, pY, pZ) * invW;
+        mask &= ~((ndcZ < Vec4f(Depth::minZ)) | (ndcZ > Vec4f(Depth::maxZ))).sign_bits();
+        if (mask == 0) return;
+
+        // early depth, per lane since the stored formats differ
+        if (DepthFormat != DEPTH_NONE) {
+            float laneZ[PACKET_SIZE];
+            ndcZ.store(laneZ);
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                if (!(mask & (1 << i))) continue;
+                int index = quadIndex >= 0 ? quadIndex + (i ^ 2) :
+                            depthIndex(db, quadX + (i & 1), height - 1 - quadY - (i >> 1));
+                typename Depth::Stored *storeZ = (typename Depth::Stored *) db->depthBuffer + index;
+                typename Depth::Stored z = Depth::store(laneZ[i]);
+                if (EqualDepth ? !Depth::equal(z, *storeZ) : !Depth::pass(z, *storeZ))
+                    mask &= ~(1 << i);
+                else if (!EqualDepth)
+                    *storeZ = z;
+            }
+            if (mask == 0) return;
+        }
+        passed += maskLanes(mask);
+
+        FragmentPacket packet;
+        packet.mask = mask;
+        packet.ndcX = interpolateLanes(cA.Clip.x, cB.Clip.x, cC.Clip.x, pX, pY, pZ) * invW;
+        packet.ndcY = interpolateLanes(cA.Clip.y, cB.Clip.y, cC.Clip.y, pX, pY, pZ) * invW;
+        packet.ndcZ = ndcZ;
+        buildPacket<Shader::varyings, Shader::flat>(face, pX, pY, pZ, packet);
+
+        FragmentPacketOut outPacket;
+        Shader::shadePacket(packet, outPacket);
+        __m128i colors = packColors(fb->format, outPacket.red.m128(), outPacket.green.m128(),
+                                    outPacket.blue.m128(), outPacket.alpha.m128());
+        if (quadIndex >= 0 && fb->format != PIXEL_RGB8) {
+            // the whole quad in one load and store, swapping its rows gives lane order
+            __m128i *quad = (__m128i *) (fb->colorBuffer + quadIndex * 4);
+            const __m128i stored = _mm_shuffle_epi32(_mm_loadu_si128(quad), _MM_SHUFFLE(1, 0, 3, 2));
+            if (Blend)
+                colors = blend(colors, stored);
+            else
+                colors = _mm_or_si128(colors, _mm_set1_epi32(0xff000000));
+            colors = _mm_blendv_epi8(stored, colors, _mm_castps_si128(Sse::laneMask(mask).m128()));
+            _mm_storeu_si128(quad, _mm_shuffle_epi32(colors, _MM_SHUFFLE(1, 0, 3, 2)));
+            return;
+        }
+        if (Blend) {
+            // lanes outside the mask may lie outside the target
+            alignas(16) unsigned int dst[PACKET_SIZE] = {0, 0, 0, 0};
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                if (mask & (1 << i))
+                    dst[i] = loadPacked(fb, quadX + (i & 1), height - 1 - quadY - (i >> 1));
+            }
+            colors = blend(colors, _mm_load_si128((const __m128i *) dst));
+        } else {
+            colors = _mm_or_si128(colors, _mm_set1_epi32(0xff000000));
+        }
+        alignas(16) unsigned int pixels[PACKET_SIZE];
+        _mm_store_si128((__m128i *) pixels, colors);
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            if (mask & (1 << i))
+                storePacked(fb, quadX + (i & 1), height - 1 - quadY - (i >> 1), pixels[i]);
+        }
+    };
+
+    if (fb->layout != LAYOUT_LINEAR && (DepthFormat == DEPTH_NONE || db->layout == fb->layout)) {
+        int shift = tileShift(fb->layout);
+        int tileSize = 1 << shift, tileMask = tileSize - 1;
+        int minRow = height - 1 - maxY, maxRow = height - 1 - minY;
+        int spanMin[1 << 4], spanMax[1 << 4]; //rows of the largest tile
+        for (int bandRow = minRow & ~tileMask; bandRow <= maxRow; bandRow += tileSize) {
+            int bandMinX = clipMaxX + 1, bandMaxX = clipMinX - 1;
+            for (int r = 0; r < tileSize; r++) {
+                int row = bandRow + r;
+                spanMin[r] = clipMaxX + 1;
+                spanMax[r] = clipMinX - 1;
+                if (row < minRow || row > maxRow) continue;
+                float x1, x2;
+                calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, (float) (height - 1 - row), x1, x2);
+                spanMin[r] = max(clipMinX, roundf(min(x1, x2)));
+                spanMax[r] = min(clipMaxX, roundf(max(x1, x2)));
+                bandMinX = min(bandMinX, spanMin[r]);
+                bandMaxX = max(bandMaxX, spanMax[r]);
+            }
+            int bandBase = ((bandRow >> shift) * fb->tilesX) << (shift * 2);
+            for (int tileX = bandMinX & ~tileMask; tileX <= bandMaxX; tileX += tileSize) {
+                int tileBase = bandBase + ((tileX >> shift) << (shift * 2));
+                for (int r = 0; r < tileSize; r += 2) {
+                    int quadMinX = max(tileX, min(spanMin[r], spanMin[r + 1]) & ~1);
+                    int quadMaxX = min(tileX + tileMask, max(spanMax[r], spanMax[r + 1]));
+                    for (int quadX = quadMinX; quadX <= quadMaxX; quadX += 2) {
+                        int mask = 0;
+                        for (int i = 0; i < PACKET_SIZE; i++) {
+                            int x = quadX + (i & 1), span = r + 1 - (i >> 1);
+                            if (x >= spanMin[span] && x <= spanMax[span]) mask |= 1 << i;
+                        }
+                        if (mask != 0)
+                            shadeQuad(quadX, height - 2 - bandRow - r, mask,
+                                      tileBase + mortonIndex(quadX & tileMask, r));
+                    }
+                }
+            }
+        }
+        rasterFragments += passed;
+        return;
+    }
+
+    for (int quadY = minY & ~1; quadY <= maxY; quadY += 2) {
+        int spanMin[2], spanMax[2];
+        for (int r = 0; r < 2; r++) {
+            int scrY = quadY + r;
+            spanMin[r] = clipMaxX + 1;
+            spanMax[r] = clipMinX - 1;
+            if (scrY < minY || scrY > maxY) continue;
+            float x1, x2;
+            calcBounds(scrAX, scrAY, scrBX, scrBY, scrCX, scrCY, (float) scrY, x1, x2);
+            spanMin[r] = max(clipMinX, roundf(min(x1, x2)));
+            spanMax[r] = min(clipMaxX, roundf(max(x1, x2)));
+        }
+        int quadMinX = min(spanMin[0], spanMin[1]) & ~1;
+        int quadMaxX = max(spanMax[0], spanMax[1]);
+        for (int quadX = quadMinX; quadX <= quadMaxX; quadX += 2) {
+            int mask = 0;
+            for (int i = 0; i < PACKET_SIZE; i++) {
+                int x = quadX + (i & 1), r = i >> 1;
+                if (x >= spanMin[r] && x <= spanMax[r]) mask |= 1 << i;
+            }
+            if (mask != 0)
+                shadeQuad(quadX, quadY, mask, -1);
+        }
+    }
+    rasterFragments += passed;
+}
+
+template<class Shader, int DepthFormat, bool Blend, bool EqualDepth>
+inline void rasterizeVariant(FrameBuffer *fb, DepthBuffer *db, const Face *face) {
+    if constexpr (Shader::packet)
+        rasterizeQuads<Shader, DepthFormat, Blend, EqualDepth>(fb, db, face);
+    else
+        rasterizeSingle<Shader, DepthFormat, Blend, EqualDepth>(fb, db, nullptr, face);
+}
+
+template<int Cull>
+inline bool cullFace(const Face *face) {
+    if (Cull == CULL_NONE) return false;
+    Vec3 eyeVec = Vec3(eyeX, eyeY, eyeZ) - face->clipA.World.Trim();
+    float facing = eyeVec.DotProduct(face->clipA.Normal);
+    return Cull == CULL_BACK ? facing <= 0 : facing >= 0;
+}
+
+// drawFaces for single sampled targets with everything but the vertex shader fixed
+template<class Shader, int DepthFormat, bool Blend, bool EqualDepth, int Cull>
+void drawFacesVariant(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, const Vertex *buffer, int count) {
+    // culling a clipped face reads its World and Normal
+    const int clipVaryings = Shader::varyings | (Cull != CULL_NONE ? VARYING_WORLD | VARYING_NORMAL : 0);
+    for (int i = 0; i < count; i++) {
+        Face *face = frameArena->create<Face>(buffer[i * 3], buffer[i * 3 + 1], buffer[i * 3 + 2]);
+        vs(face->modelA, face->clipA);
+        vs(face->modelB, face->clipB);
+        vs(face->modelC, face->clipC);
+        if (cullFace<Cull>(face))
+            continue;
+        int clipFlag = checkFace(face);
+        if (clipFlag == 0b000)
+            continue;
+        if (clipFlag == 0b111) {
+            face->calculateClipMatrixInv();
+            face->calculateNDCVertex();
+            rasterizeVariant<Shader, DepthFormat, Blend, EqualDepth>(fb, db, face);
+            continue;
+        }
+        Face *clipped[2];
+        int clippedNum = fixFaces(face, clipFlag, clipped, clipVaryings, Shader::flat);
+        for (int j = 0; j < clippedNum; j++) {
+            if (cullFace<Cull>(clipped[j]))
+                continue;
+            clipped[j]->calculateClipMatrixInv();
+            clipped[j]->calculateNDCVertex();
+            rasterizeVariant<Shader, DepthFormat, Blend, EqualDepth>(fb, db, clipped[j]);
+        }
+    }
+}
+
+typedef void (*DrawVariant)(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, const Vertex *buffer, int count);
+
+#define VARIANT_DEPTH_MODES 5 //DEPTH_NONE and the four depth formats
+#define VARIANT_COUNT (VARIANT_DEPTH_MODES * 2 * 2 * 3)
+
+inline int variantIndex(int depthFormat, bool blend, bool equalDepth, int cullFlag) {
+    return (((depthFormat + 1) * 2 + (blend ? 1 : 0)) * 2 + (equalDepth ? 1 : 0)) * 3 + cullFlag;
+}
+
+template<class Shader, int DepthFormat, bool Blend, bool EqualDepth>
+void fillCullVariants(DrawVariant *variants) {
+    variants[variantIndex(DepthFormat, Blend, EqualDepth, CULL_BACK)] =
+            drawFacesVariant<Shader, DepthFormat, Blend, EqualDepth, CULL_BACK>;
+    variants[variantIndex(DepthFormat, Blend, EqualDepth, CULL_FRONT)] =
+            drawFacesVariant<Shader, DepthFormat, Blend, EqualDepth, CULL_FRONT>;
+    variants[variantIndex(DepthFormat, Blend, EqualDepth, CULL_NONE)] =
+            drawFacesVariant<Shader, DepthFormat, Blend, EqualDepth, CULL_NONE>;
+}
+
+// depth only passes neither blend nor run after a prepass, blended draws are not in the prepass
+template<class Shader, int DepthFormat>
+void fillBlendVariants(DrawVariant *variants) {
+    fillCullVariants<Shader, DepthFormat, false, false>(variants);
+    if (!Shader::depthOnly) {
+        fillCullVariants<Shader, DepthFormat, true, false>(variants);
+        fillCullVariants<Shader, DepthFormat, false, true>(variants);
+    }
+}
+
+template<class Shader>
+void fillVariants(DrawVariant *variants) {
+    fillBlendVariants<Shader, DEPTH_NONE>(variants);
+    fillBlendVariants<Shader, DEPTH_FLOAT32>(variants);
+    fillBlendVariants<Shader, DEPTH_UNORM16>(variants);
+    fillBlendVariants<Shader, DEPTH_FIXED24>(variants);
+    fillBlendVariants<Shader, DEPTH_FLOAT32_REV>(variants);
+}
+
+// table of the variants drawn for fs, nullptr when it is registered already or the registry is full
+DrawVariant *addShaderVariants(FragmentShader fs);
+
+// drawFaces with Fs uses the specialized loops from now on, other shaders take the generic path.
+// Only the VARYING_* in Varyings are interpolated and clipped for it, the ones in Flat
+// are taken from a single vertex. With TwoTargets its Color1 goes to secondTarget.
+template<FragmentShader Fs, int Varyings = VARYING_ALL, int Flat = 0, bool TwoTargets = false>
+void registerShaderVariants() {
+    DrawVariant *variants = addShaderVariants(Fs);
+    if (variants != nullptr)
+        fillVariants<StaticShader<Fs, Varyings, Flat, TwoTargets>>(variants);
+}
+
+// as above, but the specialized loops shade 2x2 quads with Ps, Fs stays the
+// shader of the generic and multisampled paths
+template<FragmentShader Fs, PacketShader Ps, int Varyings = VARYING_ALL, int Flat = 0>
+void registerShaderVariants() {
+    DrawVariant *variants = addShaderVariants(Fs);
+    if (variants != nullptr)
+        fillVariants<StaticPacketShader<Ps, Varyings, Flat>>(variants);
+}
+
+#endif /* RASTERVARIANT_H_ */
@@ -1,59 +1,732 @@
+#include <atomic>
+#include <smmintrin.h>
 #include "sampler.h"
+#include "graphicLib.h"
+#include "../texture/blockCompression.h"
+
+#define TEXEL_PADDING 16 //bytes after the texels of a level, see bilinearTexel
+#define BLOCK_CACHE_SHIFT 4 //the per thread cache holds a square of 16x16 decoded blocks
+
+struct DecodedBlock {
+    const unsigned char *block;
+    unsigned int owner;
+    alignas(16) unsigned char texels[64];
+};
+
+RENDER_LOCAL DecodedBlock blockCache[1 << (2 * BLOCK_CACHE_SHIFT)];
+static std::atomic<unsigned int> nextStorageId(0);
 
 Sampler::Sampler(int sw, int sh) {
     width = sw;
     height = sh;
-    imgData = new unsigned char[width * height * 3];
-    memset(imgData, 0, width * height * 3 * sizeof(unsigned char));
+    colorTarget = nullptr;
+    depthTarget = nullptr;
+    imgData = new unsigned char[width * height * 4 + TEXEL_PADDING];
+    memset(imgData, 0, (width * height * 4 + TEXEL_PADDING) * sizeof(unsigned char));
+    mips[0] = {imgData, width, height, 0, 0};
+    mipLevels = 1;
+    mipData = nullptr;
+    texelLayout = LAYOUT_LINEAR;
+    texelFormat = TEXEL_RGBA8;
+    storageId = 0;
+    bindState(samplerBilinear);
+}
+
+Sampler::Sampler(int sw, int sh, int format, int levels, const unsigned char *blocks) {
+    width = sw;
+    height = sh;
+    colorTarget = nullptr;
+    depthTarget = nullptr;
+    imgData = nullptr;
+    mips[0] = {nullptr, width, height, 0, 0};
+    mipLevels = 1;
+    mipData = nullptr;
+    texelLayout = LAYOUT_LINEAR;
+    texelFormat = TEXEL_RGBA8;
+    storageId = 0;
+    bindState(samplerBilinear);
+    setCompressedLevels(format, levels, blocks);
+}
+
+Sampler::Sampler(const FrameBuffer *fb) {
+    width = fb->width;
+    height = fb->height;
+    colorTarget = fb;
+    depthTarget = nullptr;
+    imgData = nullptr;
+    mips[0] = {nullptr, width, height, 0, 0};
+    mipLevels = 1;
+    mipData = nullptr;
+    texelLayout = LAYOUT_LINEAR;
+    texelFormat = TEXEL_RGBA8;
+    storageId = 0;
+    bindState(samplerBilinear);
+}
+
+Sampler::Sampler(const DepthBuffer *db) {
+    width = db->width;
+    height = db->height;
+    colorTarget = nullptr;
+    depthTarget = db;
+    imgData = nullptr;
+    mips[0] = {nullptr, width, height, 0, 0};
+    mipLevels = 1;
+    mipData = nullptr;
+    texelLayout = LAYOUT_LINEAR;
+    texelFormat = TEXEL_RGBA8;
+    storageId = 0;
+    bindState(samplerBilinear);
 }
 
 Sampler::~Sampler() {
     delete[] imgData;
+    delete[] mipData;
     printf("release sampler\n");
 }
 
+// 2x2 box of rgba texels, a last odd row or column of src is dropped. Four texels
+// at a time: eight source texels of each row are split into the even and the odd
+// ones and summed in 16 bits.
+void downsample(const unsigned char *src, int srcWidth, int srcHeight,
+                unsigned char *dst, int dstWidth, int dstHeight) {
+    const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+    for (int y = 0; y < dstHeight; y++) {
+        const unsigned char *rows[2] = {src + 4 * (2 * y) * srcWidth,
+                                        src + 4 * min(2 * y + 1, srcHeight - 1) * srcWidth};
+        unsigned char *out = dst + 4 * y * dstWidth;
+        int x = 0;
+        for (; x + 4 <= dstWidth; x += 4) {
+            __m128i sumLo = two, sumHi = two;
+            for (const unsigned char *row : rows) {
+                const __m128 lo = _mm_loadu_ps((const float *) (row + 8 * x));
+                const __m128 hi = _mm_loadu_ps((const float *) (row + 8 * x + 16));
+                const __m128i even = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0)));
+                const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1)));
+                sumLo = _mm_add_epi16(sumLo, _mm_add_epi16(_mm_unpacklo_epi8(even, zero), _mm_unpacklo_epi8(odd, zero)));
+                sumHi = _mm_add_epi16(sumHi, _mm_add_epi16(_mm_unpackhi_epi8(even, zero), _mm_unpackhi_epi8(odd, zero)));
+            }
+            _mm_storeu_si128((__m128i *) (out + 4 * x),
+                             _mm_packus_epi16(_mm_srli_epi16(sumLo, 2), _mm_srli_epi16(sumHi, 2)));
+        }
+        for (; x < dstWidth; x++) {
+            const int x0 = 4 * (2 * x), x1 = 4 * min(2 * x + 1, srcWidth - 1);
+            for (int c = 0; c < 4; c++)
+                out[4 * x + c] = (unsigned char) ((rows[0][x0 + c] + rows[0][x1 + c] +
+                                                   rows[1][x0 + c] + rows[1][x1 + c] + 2) >> 2);
+        }
+    }
+}
+
+void Sampler::generateMipmaps() {
+    if (imgData == nullptr || texelLayout != LAYOUT_LINEAR || texelFormat != TEXEL_RGBA8) return;
+    int levels = 1, size = TEXEL_PADDING;
+    for (int w = width, h = height; (w > 1 || h > 1) && levels < MAX_MIP_LEVELS; levels++) {
+        w = max(1, w / 2);
+        h = max(1, h / 2);
+        size += w * h * 4;
+    }
+    delete[] mipData;
+    mipData = new unsigned char[size];
+    memset(mipData, 0, size);
+    unsigned char *texels = mipData;
+    for (int i = 1; i < levels; i++) {
+        const MipLevel &prev = mips[i - 1];
+        mips[i] = {texels, max(1, prev.width / 2), max(1, prev.height / 2), 0, 0};
+        downsample(prev.texels, prev.width, prev.height, texels, mips[i].width, mips[i].height);
+        texels += mips[i].width * mips[i].height * 4;
+    }
+    mipLevels = levels;
+    bindState(state);
+}
+
+void Sampler::setTexelLayout(int layout) {
+    if (imgData == nullptr || layout == texelLayout || texelFormat != TEXEL_RGBA8) return;
+    MipLevel tiled[MAX_MIP_LEVELS];
+    int sizes[MAX_MIP_LEVELS], mipSize = TEXEL_PADDING;
+    for (int i = 0; i < mipLevels; i++) {
+        tiled[i] = mips[i];
+        calcTiles(layout, mips[i].width, mips[i].height, tiled[i].tilesX, tiled[i].tilesY);
+        sizes[i] = 4 * bufferElements(layout, mips[i].width, mips[i].height, tiled[i].tilesX, tiled[i].tilesY);
+        if (i > 0) mipSize += sizes[i];
+    }
+    unsigned char *levelData = new unsigned char[sizes[0] + TEXEL_PADDING];
+    unsigned char *tiledMips = mipLevels > 1 ? new unsigned char[mipSize] : nullptr;
+    memset(levelData, 0, sizes[0] + TEXEL_PADDING);
+    if (tiledMips != nullptr) memset(tiledMips, 0, mipSize);
+    unsigned char *texels = tiledMips;
+    for (int i = 0; i < mipLevels; i++) {
+        unsigned char *dst = i == 0 ? levelData : texels;
+        if (i > 0) texels += sizes[i];
+        for (int row = 0; row < mips[i].height; row++) {
+            for (int x = 0; x < mips[i].width; x++)
+                memcpy(dst + texelOffset(layout, tiled[i], x, row),
+                       mips[i].texels + texelOffset(texelLayout, mips[i], x, row), 4);
+        }
+        tiled[i].texels = dst;
+    }
+    delete[] imgData;
+    delete[] mipData;
+    imgData = levelData;
+    mipData = tiledMips;
+    texelLayout = layout;
+    for (int i = 0; i < mipLevels; i++)
+        mips[i] = tiled[i];
+}
+
+void Sampler::compress(int format) {
+    if (imgData == nullptr || texelFormat != TEXEL_RGBA8 || format == TEXEL_RGBA8) return;
+    setTexelLayout(LAYOUT_LINEAR);
+    int size = 0;
+    for (int i = 0; i < mipLevels; i++)
+        size += compressedSize(format, mips[i].width, mips[i].height);
+    unsigned char *blocks = new unsigned char[size];
+    unsigned char *dst = blocks;
+    for (int i = 0; i < mipLevels; i++) {
+        compressTexels(format, mips[i].texels, mips[i].width, mips[i].height, dst);
+        dst += compressedSize(format, mips[i].width, mips[i].height);
+    }
+    setCompressedLevels(format, mipLevels, blocks);
+    delete[] blocks;
+}
+
+void Sampler::setCompressedLevels(int format, int levels, const unsigned char *blocks) {
+    if (colorTarget != nullptr || depthTarget != nullptr) return;
+    levels = max(1, min(levels, MAX_MIP_LEVELS));
+    MipLevel compressed[MAX_MIP_LEVELS];
+    int sizes[MAX_MIP_LEVELS], mipSize = TEXEL_PADDING;
+    for (int i = 0, w = width, h = height; i < levels; i++) {
+        compressed[i] = {nullptr, w, h, (w + 3) / 4, (h + 3) / 4};
+        sizes[i] = compressedSize(format, w, h);
+        if (i > 0) mipSize += sizes[i];
+        w = max(1, w / 2);
+        h = max(1, h / 2);
+    }
+    delete[] imgData;
+    delete[] mipData;
+    imgData = new unsigned char[sizes[0] + TEXEL_PADDING];
+    mipData = levels > 1 ? new unsigned char[mipSize] : nullptr;
+    memset(imgData + sizes[0], 0, TEXEL_PADDING);
+    unsigned char *texels = mipData;
+    for (int i = 0; i < levels; i++) {
+        unsigned char *dst = i == 0 ? imgData : texels;
+        if (i > 0) texels += sizes[i];
+        memcpy(dst, blocks, sizes[i]);
+        blocks += sizes[i];
+        compressed[i].texels = dst;
+        mips[i] = compressed[i];
+    }
+    mipLevels = levels;
+    texelFormat = format;
+    texelLayout = LAYOUT_LINEAR;
+    storageId = ++nextStorageId;
+    bindState(state);
+}
+
+const unsigned char *Sampler::getLevelTexels(int level, int &levelWidth, int &levelHeight) const {
+    levelWidth = mips[level].width;
+    levelHeight = mips[level].height;
+    return mips[level].texels;
+}
+
+const unsigned char *Sampler::decodedBlock(const MipLevel &level, int bx, int by) const {
+    const unsigned char *block = level.texels + blockBytes(texelFormat) * (by * level.tilesX + bx);
+    // blocks of a square of the level land in distinct slots, so a footprint never evicts itself
+    const int side = (1 << BLOCK_CACHE_SHIFT) - 1;
+    const unsigned int slot = ((((by & side) << BLOCK_CACHE_SHIFT) | (bx & side)) ^
+                               (unsigned int) ((size_t) level.texels >> 6)) & ((1 << (2 * BLOCK_CACHE_SHIFT)) - 1);
+    DecodedBlock &entry = blockCache[slot];
+    if (entry.block != block || entry.owner != storageId) {
+        decodeBlock(texelFormat, block, entry.texels);
+        entry.block = block;
+        entry.owner = storageId;
+    }
+    return entry.texels;
+}
+
+int Sampler::compressedTexel(const MipLevel &level, int x, int row) const {
+    return *(const int *) (decodedBlock(level, x >> 2, row >> 2) + 4 * (((row & 3) << 2) | (x & 3)));
+}
+
+// rgb 0..255 of a render target texel, row 0 is the top of the image
+Vec3 Sampler::fetchColor(int x, int row) const {
+    const unsigned char *pixel = colorTarget->colorBuffer + pixelOffset(colorTarget, x, row);
+    if (colorTarget->format == PIXEL_RGB8)
+        return Vec3{float(pixel[0]), float(pixel[1]), float(pixel[2])};
+    unsigned char r, g, b;
+    unpackPixel(colorTarget->format, *(const unsigned int *) pixel, r, g, b);
+    return Vec3{float(r), float(g), float(b)};
+}
+
+// Texel (iu, iv) and its neighbours in u and v weighted by 8 bit fractions fu, fv of
+// the neighbours, returns r, g, b, a 0..255 in the low four 16 bit lanes. Both texels
+// of a row come with one 64 bit load where they are adjacent in memory or in a decoded block.
+template<bool Compressed>
+__m128i Sampler::bilinearTexel(const MipLevel &level, int iu, int iv, int fu, int fv) const {
+    const int uNext = iu + 1 <= (level.width - 1) ? iu + 1 : iu;
+    const int vNext = iv + 1 <= (level.height - 1) ? iv + 1 : iv;
+    __m128i top, bottom;
+    if (Compressed) {
+        if ((iu & 3) != 3) {
+            // both columns in one block, a texel past the level edge is its padding with fu 0
+            const int x = 4 * (iu & 3);
+            top = _mm_loadl_epi64((const __m128i *) (decodedBlock(level, iu >> 2, iv >> 2) + 16 * (iv & 3) + x));
+            bottom = _mm_loadl_epi64(
+                    (const __m128i *) (decodedBlock(level, iu >> 2, vNext >> 2) + 16 * (vNext & 3) + x));
+        } else {
+            top = _mm_unpacklo_epi32(_mm_cvtsi32_si128(compressedTexel(level, iu, iv)),
+                                     _mm_cvtsi32_si128(compressedTexel(level, uNext, iv)));
+            bottom = _mm_unpacklo_epi32(_mm_cvtsi32_si128(compressedTexel(level, iu, vNext)),
+                                        _mm_cvtsi32_si128(compressedTexel(level, uNext, vNext)));
+        }
+    } else {
+        const unsigned char *row = level.texels + texelRow(texelLayout, level, iv);
+        const unsigned char *rowNext = level.texels + texelRow(texelLayout, level, vNext);
+        const int x = texelColumn(texelLayout, iu);
+        if (texelLayout == LAYOUT_LINEAR || (iu & 1) == 0) {
+            // past the last texel of a row fu is 0, the padding keeps the load inside the level
+            top = _mm_loadl_epi64((const __m128i *) (row + x));
+            bottom = _mm_loadl_epi64((const __m128i *) (rowNext + x));
+        } else {
+            const int xNext = texelColumn(texelLayout, uNext);
+            top = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int *) (row + x)),
+                                     _mm_cvtsi32_si128(*(const int *) (row + xNext)));
+            bottom = _mm_unpacklo_epi32(_mm_cvtsi32_si128(*(const int *) (rowNext + x)),
+                                        _mm_cvtsi32_si128(*(const int *) (rowNext + xNext)));
+        }
+    }
+    const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+    // both columns lerped in v, then the texel and the next one in u; every sum stays below 65536
+    __m128i columns = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(top, zero), _mm_set1_epi16(256 - fv)),
+                                    _mm_mullo_epi16(_mm_unpacklo_epi8(bottom, zero), _mm_set1_epi16(fv)));
+    columns = _mm_srli_epi16(_mm_add_epi16(columns, half), 8);
+    __m128i texel = _mm_mullo_epi16(columns, _mm_unpacklo_epi64(_mm_set1_epi16(256 - fu), _mm_set1_epi16(fu)));
+    texel = _mm_add_epi16(texel, _mm_srli_si128(texel, 8));
+    return _mm_srli_epi16(_mm_add_epi16(texel, half), 8);
+}
+
+// the lookup of texture2D on one level of the chain
+template<bool Compressed>
+__m128i Sampler::bilinear(const MipLevel &level, float s, float t) const {
+    float u = (float) (level.width - 1) * s;
+    float v = (float) (level.height - 1) * (1.0f - t);
+    int iu = (int) u;
+    int iv = (int) v;
+    return bilinearTexel<Compressed>(level, iu, iv, (int) ((u - iu) * 256.0f), (int) ((v - iv) * 256.0f));
+}
+
+// 16 bit texels a and b mixed with the 8 bit weight of b
+inline __m128i lerpTexels(__m128i a, __m128i b, int weight) {
+    const __m128i mixed = _mm_add_epi16(_mm_mullo_epi16(a, _mm_set1_epi16(256 - weight)),
+                                        _mm_mullo_epi16(b, _mm_set1_epi16(weight)));
+    return _mm_srli_epi16(_mm_add_epi16(mixed, _mm_set1_epi16(128)), 8);
+}
+
+// r, g, b of a 16 bit texel scaled to 0..1, alpha 1
+inline Vec4 texelColor(__m128i texel) {
+    const Sse::Vec4f rgba(_mm_cvtepi32_ps(_mm_unpacklo_epi16(texel, _mm_setzero_si128())));
+    return Vec4(Sse::select(Sse::laneMask(8), Sse::Vec4f(1.0f), rgba * Sse::Vec4f(INV_SCALE)));
+}
+
+template<bool Compressed>
+void Sampler::bilinear(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const {
+    float lastU[PACKET_SIZE], lastV[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        lastU[i] = (float) (mips[levels[i]].width - 1);
+        lastV[i] = (float) (mips[levels[i]].height - 1);
+    }
+    const Sse::Vec4f u = Sse::Vec4f::load(lastU) * s;
+    const Sse::Vec4f v = Sse::Vec4f::load(lastV) * (Sse::Vec4f(1.0f) - t);
+    const __m128i iu = _mm_cvttps_epi32(u.m128()), iv = _mm_cvttps_epi32(v.m128());
+    const Sse::Vec4f fixedScale(256.0f);
+    const __m128i fu = _mm_cvttps_epi32(((u - Sse::Vec4f(_mm_cvtepi32_ps(iu))) * fixedScale).m128());
+    const __m128i fv = _mm_cvttps_epi32(((v - Sse::Vec4f(_mm_cvtepi32_ps(iv))) * fixedScale).m128());
+    alignas(16) int ius[PACKET_SIZE], ivs[PACKET_SIZE], fus[PACKET_SIZE], fvs[PACKET_SIZE];
+    _mm_store_si128((__m128i *) ius, iu);
+    _mm_store_si128((__m128i *) ivs, iv);
+    _mm_store_si128((__m128i *) fus, fu);
+    _mm_store_si128((__m128i *) fvs, fv);
+
+    // one rgba lane vector per lane, transposed into channels
+    __m128 texels[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        texels[i] = _mm_setzero_ps();
+        if (!(mask & (1 << i))) continue;
+        const __m128i texel = bilinearTexel<Compressed>(mips[levels[i]], ius[i], ivs[i], fus[i], fvs[i]);
+        texels[i] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(texel, _mm_setzero_si128()));
+    }
+    _MM_TRANSPOSE4_PS(texels[0], texels[1], texels[2], texels[3]);
+    channels[0] = Sse::Vec4f(texels[0]);
+    channels[1] = Sse::Vec4f(texels[1]);
+    channels[2] = Sse::Vec4f(texels[2]);
+}
+
+template<bool Compressed>
+__m128i Sampler::point(const MipLevel &level, float s, float t) const {
+    const int iu = (int) ((float) (level.width - 1) * s + 0.5f);
+    const int iv = (int) ((float) (level.height - 1) * (1.0f - t) + 0.5f);
+    const int texel = Compressed ? compressedTexel(level, iu, iv)
+                                 : *(const int *) (level.texels + texelOffset(texelLayout, level, iu, iv));
+    return _mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), _mm_setzero_si128());
+}
+
+template<bool Compressed>
+void Sampler::point(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const {
+    __m128 texels[PACKET_SIZE];
+    float ss[PACKET_SIZE], ts[PACKET_SIZE];
+    s.store(ss);
+    t.store(ts);
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        texels[i] = _mm_setzero_ps();
+        if (!(mask & (1 << i))) continue;
+        const __m128i texel = point<Compressed>(mips[levels[i]], ss[i], ts[i]);
+        texels[i] = _mm_cvtepi32_ps(_mm_unpacklo_epi16(texel, _mm_setzero_si128()));
+    }
+    _MM_TRANSPOSE4_PS(texels[0], texels[1], texels[2], texels[3]);
+    channels[0] = Sse::Vec4f(texels[0]);
+    channels[1] = Sse::Vec4f(texels[1]);
+    channels[2] = Sse::Vec4f(texels[2]);
+}
+
+template<int Filter, bool Compressed>
+__m128i Sampler::filterLevel(const MipLevel &level, float s, float t) const {
+    return Filter == FILTER_POINT ? point<Compressed>(level, s, t) : bilinear<Compressed>(level, s, t);
+}
+
+template<int Filter, bool Compressed>
+void Sampler::filterLevels(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const {
+    if (Filter == FILTER_POINT)
+        point<Compressed>(levels, s, t, mask, channels);
+    else
+        bilinear<Compressed>(levels, s, t, mask, channels);
+}
+
+// Texture coordinate into 0..1. Texel centers sit on the integer coordinates of
+// (width - 1) * s, so repeat and mirror put the last texel next to the first one.
+template<int Wrap>
+inline float wrapCoord(float x) {
+    if (Wrap == WRAP_CLAMP)
+        return max(0.0f, min(x, 1.0f));
+    if (Wrap == WRAP_REPEAT)
+        return min(x - floorf(x), 1.0f);
+    const float m = x - 2.0f * floorf(x * 0.5f);
+    return max(0.0f, min(m > 1.0f ? 2.0f - m : m, 1.0f));
+}
+
+template<int Wrap>
+inline Sse::Vec4f wrapCoord(Sse::Vec4f x) {
+    const Sse::Vec4f zero(0.0f), one(1.0f);
+    if (Wrap == WRAP_CLAMP)
+        return x.clamp(zero, one);
+    if (Wrap == WRAP_REPEAT)
+        return x.fraction().clamp(zero, one);
+    const Sse::Vec4f m = x - Sse::Vec4f(2.0f) * (x * Sse::Vec4f(0.5f)).floor();
+    return Sse::select(m > one, Sse::Vec4f(2.0f) - m, m).clamp(zero, one);
+}
+
+template<int WrapS, int WrapT, int Filter, int Mip, bool Compressed>
+__m128i Sampler::lookupTexel(const Sampler *sampler, float s, float t, float lod) {
+    s = wrapCoord<WrapS>(s);
+    t = wrapCoord<WrapT>(t);
+    if (Mip == MIP_NONE)
+        return sampler->filterLevel<Filter, Compressed>(sampler->mips[0], s, t);
+    lod = max(0.0f, min(lod, (float) (sampler->mipLevels - 1)));
+    if (Mip == MIP_NEAREST)
+        return sampler->filterLevel<Filter, Compressed>(sampler->mips[(int) (lod + 0.5f)], s, t);
+    int level = (int) lod;
+    int next = (int) ((lod - level) * 256.0f);
+    __m128i texel = sampler->filterLevel<Filter, Compressed>(sampler->mips[level], s, t);
+    if (next > 0)
+        texel = lerpTexels(texel, sampler->filterLevel<Filter, Compressed>(sampler->mips[level + 1], s, t), next);
+    return texel;
+}
+
+template<int WrapS, int WrapT, int Filter, int Mip, bool Compressed>
+void Sampler::lookupPacket(const Sampler *sampler, Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f lod, int mask,
+                           Sse::Vec4f *channels) {
+    s = wrapCoord<WrapS>(s);
+    t = wrapCoord<WrapT>(t);
+    int levels[PACKET_SIZE] = {0, 0, 0, 0};
+    if (Mip == MIP_NONE) {
+        sampler->filterLevels<Filter, Compressed>(levels, s, t, mask, channels);
+        return;
+    }
+    const Sse::Vec4f top((float) (sampler->mipLevels - 1)), zero(0.0f);
+    lod = Sse::select(lod > top, top, Sse::select(lod > zero, lod, zero));
+    if (Mip == MIP_NEAREST) {
+        _mm_storeu_si128((__m128i *) levels, _mm_cvttps_epi32((lod + Sse::Vec4f(0.5f)).m128()));
+        sampler->filterLevels<Filter, Compressed>(levels, s, t, mask, channels);
+        return;
+    }
+    const __m128i level = _mm_cvttps_epi32(lod.m128());
+    const Sse::Vec4f next = lod - Sse::Vec4f(_mm_cvtepi32_ps(level));
+    _mm_storeu_si128((__m128i *) levels, level);
+    sampler->filterLevels<Filter, Compressed>(levels, s, t, mask, channels);
+    // magnified lanes stay on level 0
+    int nextMask = (next > zero).sign_bits() & mask;
+    if (nextMask != 0) {
+        _mm_storeu_si128((__m128i *) levels, _mm_add_epi32(level, _mm_set1_epi32(1)));
+        for (int i = 0; i < PACKET_SIZE; i++) {
+            if (!(nextMask & (1 << i))) levels[i] = 0;
+        }
+        Sse::Vec4f nextChannels[3];
+        sampler->filterLevels<Filter, Compressed>(levels, s, t, nextMask, nextChannels);
+        for (int ch = 0; ch < 3; ch++)
+            channels[ch] = channels[ch] + (nextChannels[ch] - channels[ch]) * (next & Sse::laneMask(nextMask));
+    }
+}
+
+template<int WrapS, int WrapT, int Filter, int Mip>
+void Sampler::resolveFormat() {
+    if (texelFormat != TEXEL_RGBA8) {
+        lookup = lookupTexel<WrapS, WrapT, Filter, Mip, true>;
+        packetLookup = lookupPacket<WrapS, WrapT, Filter, Mip, true>;
+    } else {
+        lookup = lookupTexel<WrapS, WrapT, Filter, Mip, false>;
+        packetLookup = lookupPacket<WrapS, WrapT, Filter, Mip, false>;
+    }
+}
+
+template<int WrapS, int WrapT, int Filter>
+void Sampler::resolveMip(int mip) {
+    if (mip == MIP_LINEAR)
+        resolveFormat<WrapS, WrapT, Filter, MIP_LINEAR>();
+    else if (mip == MIP_NEAREST)
+        resolveFormat<WrapS, WrapT, Filter, MIP_NEAREST>();
+    else
+        resolveFormat<WrapS, WrapT, Filter, MIP_NONE>();
+}
+
+template<int WrapS, int WrapT>
+void Sampler::resolveFilter(int filter, int mip) {
+    if (filter == FILTER_POINT)
+        resolveMip<WrapS, WrapT, FILTER_POINT>(mip);
+    else
+        resolveMip<WrapS, WrapT, FILTER_BILINEAR>(mip);
+}
+
+template<int WrapS>
+void Sampler::resolveWrapT(int wrapT, int filter, int mip) {
+    if (wrapT == WRAP_REPEAT)
+        resolveFilter<WrapS, WRAP_REPEAT>(filter, mip);
+    else if (wrapT == WRAP_MIRROR)
+        resolveFilter<WrapS, WRAP_MIRROR>(filter, mip);
+    else
+        resolveFilter<WrapS, WRAP_CLAMP>(filter, mip);
+}
+
+void Sampler::bindState(const SamplerState &samplerState) {
+    state = samplerState;
+    // a single level has nothing to choose between
+    const int mip = mipLevels > 1 ? state.mipFilter : MIP_NONE;
+    if (state.wrapS == WRAP_REPEAT)
+        resolveWrapT<WRAP_REPEAT>(state.wrapT, state.filter, mip);
+    else if (state.wrapS == WRAP_MIRROR)
+        resolveWrapT<WRAP_MIRROR>(state.wrapT, state.filter, mip);
+    else
+        resolveWrapT<WRAP_CLAMP>(state.wrapT, state.filter, mip);
+}
+
+// half the log2 of the squared footprint, log2 taken piecewise linear from the float bits
+float Sampler::levelOfDetail(float footprintSqr) const {
+    int bits;
+    memcpy(&bits, &footprintSqr, sizeof(bits));
+    return ((float) bits * (1.0f / (1 << 23)) - 127.0f) * 0.5f;
+}
+
+Sse::Vec4f Sampler::levelOfDetail(Sse::Vec4f footprintSqr) const {
+    const Sse::Vec4f bits(_mm_cvtepi32_ps(_mm_castps_si128(footprintSqr.m128())));
+    return (bits * Sse::Vec4f(1.0f / (1 << 23)) - Sse::Vec4f(127.0f)) * Sse::Vec4f(0.5f);
+}
+
+float Sampler::fetchDepth(int x, int row) const {
+    float z = readDepth(depthTarget, x, depthTarget->height - 1 - row);
+    return depthTarget->format == DEPTH_FLOAT32_REV ? z : z * 0.5f + 0.5f;
+}
+
+void Sampler::targetSize(int &w, int &h) const {
+    if (colorTarget != nullptr) {
+        w = colorTarget->width;
+        h = colorTarget->height;
+    } else if (depthTarget != nullptr) {
+        w = depthTarget->width;
+        h = depthTarget->height;
+    } else {
+        w = width;
+        h = height;
+    }
+}
+
+float Sampler::textureCompare(float s, float t, float reference) {
+    int w, h;
+    targetSize(w, h);
+    float u = (float) (w - 1) * s;
+    float v = (float) (h - 1) * (1.0 - t);
+    int iu = (int) u;
+    int iv = (int) v;
+    int uNext = iu + 1 <= (w - 1) ? iu + 1 : iu;
+    int vNext = iv + 1 <= (h - 1) ? iv + 1 : iv;
+
+    float uNextPer = u - iu;
+    float vNextPer = v - iv;
+    float uPer = 1.0f - uNextPer;
+    float vPer = 1.0f - vNextPer;
+    return (reference <= fetchDepth(iu, iv) ? uPer * vPer : 0.0f) +
+           (reference <= fetchDepth(uNext, iv) ? uNextPer * vPer : 0.0f) +
+           (reference <= fetchDepth(iu, vNext) ? uPer * vNextPer : 0.0f) +
+           (reference <= fetchDepth(uNext, vNext) ? uNextPer * vNextPer : 0.0f);
+}
+
 Vec4 Sampler::texture2D(float s, float t) {
-    float u = (float) (width - 1) * s;
-    float v = (float) (height - 1) * (1.0 - t);
+    if (imgData != nullptr)
+        return texelColor(lookup(this, s, t, 0.0f));
+    int w, h;
+    targetSize(w, h);
+    float u = (float) (w - 1) * s;
+    float v = (float) (h - 1) * (1.0 - t);
     int iu = (int) u;
     int iv = (int) v;
-    int uNext = iu + 1 <= (width - 1) ? iu + 1 : iu;
-    int vNext = iv + 1 <= (height - 1) ? iv + 1 : iv;
+    int uNext = iu + 1 <= (w - 1) ? iu + 1 : iu;
+    int vNext = iv + 1 <= (h - 1) ? iv + 1 : iv;
 
     float uNextPer = u - iu;
     float vNextPer = v - iv;
     float uPer = 1.0f - uNextPer;
     float vPer = 1.0f - vNextPer;
 
-    int imgIndex = 3 * (iv * width + iu);
-    int imgIndexNextU = 3 * (iv * width + uNext);
-    int imgIndexNextV = 3 * (vNext * width + iu);
-    int imgIndexNextUV = 3 * (vNext * width + uNext);
-    const auto color = Vec3{
-            float(imgData[imgIndex]), float(imgData[imgIndex + 1]), float(imgData[imgIndex + 2])
-    } * (uPer * vPer);
-
-    const auto colorNextU = Vec3{
-            float(imgData[imgIndexNextU]), float(imgData[imgIndexNextU + 1]), float(imgData[imgIndexNextU + 2])
-    } * (uNextPer * vPer);
-
-    const auto colorNextV = Vec3{
-            float(imgData[imgIndexNextV]), float(imgData[imgIndexNextV + 1]), float(imgData[imgIndexNextV + 2])
-    } * (uPer * vNextPer);
-
-    const auto colorNextUV = Vec3{
-            float(imgData[imgIndexNextUV]), float(imgData[imgIndexNextUV + 1]), float(imgData[imgIndexNextUV + 2])
-    } * (uNextPer * vNextPer);
+    if (depthTarget != nullptr) {
+        float depth = fetchDepth(iu, iv) * (uPer * vPer) + fetchDepth(uNext, iv) * (uNextPer * vPer) +
+                      fetchDepth(iu, vNext) * (uPer * vNextPer) + fetchDepth(uNext, vNext) * (uNextPer * vNextPer);
+        return Vec4(depth, depth, depth, 1);
+    }
+
+    const auto color = fetchColor(iu, iv) * (uPer * vPer);
+    const auto colorNextU = fetchColor(uNext, iv) * (uNextPer * vPer);
+    const auto colorNextV = fetchColor(iu, vNext) * (uPer * vNextPer);
+    const auto colorNextUV = fetchColor(uNext, vNext) * (uNextPer * vNextPer);
     return Vec4((color + colorNextU + colorNextV + colorNextUV) * INV_SCALE, 1);
 }
 
-void writeFrameBuffer2Sampler(FrameBuffer *fb, Sampler *sampler) {
-    for (int i = 0; i < fb->height; i++) {
-        for (int j = 0; j < fb->width; j++) {
-            int index = (i * fb->width + j) * 3;
-            sampler->imgData[((i) * fb->width + j) * 3] = fb->colorBuffer[index];
-            sampler->imgData[((i) * fb->width + j) * 3 + 1] = fb->colorBuffer[index + 1];
-            sampler->imgData[((i) * fb->width + j) * 3 + 2] = fb->colorBuffer[index + 2];
+Vec4 Sampler::texture2DLod(float s, float t, float lod) {
+    if (imgData == nullptr)
+        return texture2D(s, t);
+    return texelColor(lookup(this, s, t, lod));
+}
+
+Vec4 Sampler::texture2DGrad(float s, float t, float dsdx, float dtdx, float dsdy, float dtdy) {
+    float dudx = dsdx * width, dvdx = dtdx * height;
+    float dudy = dsdy * width, dvdy = dtdy * height;
+    float footprintSqr = max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+    return texture2DLod(s, t, levelOfDetail(footprintSqr) + state.lodBias);
+}
+
+void Sampler::footprint(int w, int h, Sse::Vec4f s, Sse::Vec4f t, int *iu, int *iv, int *uNext, int *vNext,
+                        Sse::Vec4f &uNextPer, Sse::Vec4f &vNextPer) {
+    float u[PACKET_SIZE], v[PACKET_SIZE];
+    (Sse::Vec4f((float) (w - 1)) * s).store(u);
+    (Sse::Vec4f((float) (h - 1)) * (Sse::Vec4f(1.0f) - t)).store(v);
+    float uBase[PACKET_SIZE], vBase[PACKET_SIZE];
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        iu[i] = (int) u[i];
+        iv[i] = (int) v[i];
+        uNext[i] = iu[i] + 1 <= (w - 1) ? iu[i] + 1 : iu[i];
+        vNext[i] = iv[i] + 1 <= (h - 1) ? iv[i] + 1 : iv[i];
+        uBase[i] = (float) iu[i];
+        vBase[i] = (float) iv[i];
+    }
+    uNextPer = Sse::Vec4f::load(u) - Sse::Vec4f::load(uBase);
+    vNextPer = Sse::Vec4f::load(v) - Sse::Vec4f::load(vBase);
+}
+
+void Sampler::texture2D(Sse::Vec4f s, Sse::Vec4f t, int mask,
+                        Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue) {
+    if (imgData != nullptr) {
+        Sse::Vec4f channels[3];
+        packetLookup(this, s, t, Sse::Vec4f(0.0f), mask, channels);
+        red = channels[0] * Sse::Vec4f(INV_SCALE);
+        green = channels[1] * Sse::Vec4f(INV_SCALE);
+        blue = channels[2] * Sse::Vec4f(INV_SCALE);
+        return;
+    }
+    int w, h;
+    targetSize(w, h);
+    int iu[PACKET_SIZE], iv[PACKET_SIZE], uNext[PACKET_SIZE], vNext[PACKET_SIZE];
+    Sse::Vec4f uNextPer, vNextPer;
+    footprint(w, h, s, t, iu, iv, uNext, vNext, uNextPer, vNextPer);
+
+    // corner texels gathered into SoA, then filtered across lanes
+    float texels[4][3][PACKET_SIZE] = {};
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        if (!(mask & (1 << i))) continue;
+        const Vec3 corners[4] = {fetchColor(iu[i], iv[i]), fetchColor(uNext[i], iv[i]),
+                                 fetchColor(iu[i], vNext[i]), fetchColor(uNext[i], vNext[i])};
+        for (int c = 0; c < 4; c++) {
+            texels[c][0][i] = corners[c].x;
+            texels[c][1][i] = corners[c].y;
+            texels[c][2][i] = corners[c].z;
         }
     }
+    const Sse::Vec4f uPer = Sse::Vec4f(1.0f) - uNextPer, vPer = Sse::Vec4f(1.0f) - vNextPer;
+    const Sse::Vec4f weights[4] = {uPer * vPer, uNextPer * vPer, uPer * vNextPer, uNextPer * vNextPer};
+    Sse::Vec4f channels[3];
+    for (int ch = 0; ch < 3; ch++) {
+        channels[ch] = Sse::Vec4f::load(texels[0][ch]) * weights[0] + Sse::Vec4f::load(texels[1][ch]) * weights[1] +
+                       Sse::Vec4f::load(texels[2][ch]) * weights[2] + Sse::Vec4f::load(texels[3][ch]) * weights[3];
+        channels[ch] = channels[ch] * Sse::Vec4f(INV_SCALE);
+    }
+    red = channels[0];
+    green = channels[1];
+    blue = channels[2];
+}
+
+void Sampler::texture2D(const float *s, const float *t, int count,
+                        Sse::Vec4f *red, Sse::Vec4f *green, Sse::Vec4f *blue) {
+    for (int i = 0; i < count; i += PACKET_SIZE) {
+        texture2D(Sse::Vec4f::load(s + i), Sse::Vec4f::load(t + i), (1 << PACKET_SIZE) - 1,
+                  red[i / PACKET_SIZE], green[i / PACKET_SIZE], blue[i / PACKET_SIZE]);
+    }
+}
+
+Sse::Vec4f Sampler::textureCompare(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f reference, int mask) {
+    int w, h;
+    targetSize(w, h);
+    int iu[PACKET_SIZE], iv[PACKET_SIZE], uNext[PACKET_SIZE], vNext[PACKET_SIZE];
+    Sse::Vec4f uNextPer, vNextPer;
+    footprint(w, h, s, t, iu, iv, uNext, vNext, uNextPer, vNextPer);
+
+    float depths[4][PACKET_SIZE] = {};
+    for (int i = 0; i < PACKET_SIZE; i++) {
+        if (!(mask & (1 << i))) continue;
+        depths[0][i] = fetchDepth(iu[i], iv[i]);
+        depths[1][i] = fetchDepth(uNext[i], iv[i]);
+        depths[2][i] = fetchDepth(iu[i], vNext[i]);
+        depths[3][i] = fetchDepth(uNext[i], vNext[i]);
+    }
+    const Sse::Vec4f uPer = Sse::Vec4f(1.0f) - uNextPer, vPer = Sse::Vec4f(1.0f) - vNextPer;
+    const Sse::Vec4f weights[4] = {uPer * vPer, uNextPer * vPer, uPer * vNextPer, uNextPer * vNextPer};
+    Sse::Vec4f lit(0.0f);
+    for (int c = 0; c < 4; c++)
+        lit = lit + (weights[c] & (reference <= Sse::Vec4f::load(depths[c])));
+    return lit & Sse::laneMask(mask);
+}
+
+void Sampler::texture2DLod(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f lod, int mask,
+                           Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue) {
+    if (imgData == nullptr) {
+        texture2D(s, t, mask, red, green, blue);
+        return;
+    }
+    Sse::Vec4f channels[3];
+    packetLookup(this, s, t, lod, mask, channels);
+    red = channels[0] * Sse::Vec4f(INV_SCALE);
+    green = channels[1] * Sse::Vec4f(INV_SCALE);
+    blue = channels[2] * Sse::Vec4f(INV_SCALE);
+}
+
+void Sampler::texture2DGrad(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f dsdx, Sse::Vec4f dtdx, Sse::Vec4f dsdy,
+                            Sse::Vec4f dtdy, int mask, Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue) {
+    const Sse::Vec4f w((float) width), h((float) height);
+    const Sse::Vec4f dudx = dsdx * w, dvdx = dtdx * h, dudy = dsdy * w, dvdy = dtdy * h;
+    const Sse::Vec4f x = dudx * dudx + dvdx * dvdx, y = dudy * dudy + dvdy * dvdy;
+    const Sse::Vec4f footprintSqr = Sse::select(x > y, x, y);
+    texture2DLod(s, t, levelOfDetail(footprintSqr) + Sse::Vec4f(state.lodBias), mask, red, green, blue);
 }
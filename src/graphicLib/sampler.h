@@ -4,20 +4,194 @@
 #include "../texture/BmpLoader.h"
 #include "../Maths/Maths.h"
 #include "../header/header.h"
+#include "samplerState.h"
 
 class Sampler {
 private:
+    struct MipLevel {
+        const unsigned char *texels; //rgba or blocks of texelFormat, row 0 is the top of the image
+        int width, height;
+        int tilesX, tilesY; //of texelLayout, or 4x4 blocks
+    };
+
     int width, height;
+    const FrameBuffer *colorTarget;
+    const DepthBuffer *depthTarget;
+    MipLevel mips[MAX_MIP_LEVELS];
+    int mipLevels;
+    unsigned char *mipData; //levels 1.. back to back
+    int texelLayout;
+    int texelFormat;
+    unsigned int storageId; //tells the blocks of different samplers apart in the decoded block cache
+
+    // lookups of texture samplers specialized by bindState for its state, rgba 0..255 in
+    // the low four 16 bit lanes or PACKET_SIZE lanes of r, g, b
+    typedef __m128i (*Lookup)(const Sampler *sampler, float s, float t, float lod);
+    typedef void (*PacketLookup)(const Sampler *sampler, Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f lod, int mask,
+                                 Sse::Vec4f *channels);
+    SamplerState state;
+    Lookup lookup;
+    PacketLookup packetLookup;
+
+    template<int WrapS, int WrapT, int Filter, int Mip, bool Compressed>
+    static __m128i lookupTexel(const Sampler *sampler, float s, float t, float lod);
+
+    template<int WrapS, int WrapT, int Filter, int Mip, bool Compressed>
+    static void lookupPacket(const Sampler *sampler, Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f lod, int mask,
+                             Sse::Vec4f *channels);
+
+    // BC levels fetch through the decoded block cache, rgba8 ones straight from the texels
+    template<int WrapS, int WrapT, int Filter, int Mip>
+    void resolveFormat();
+
+    template<int WrapS, int WrapT, int Filter>
+    void resolveMip(int mip);
+
+    template<int WrapS, int WrapT>
+    void resolveFilter(int filter, int mip);
+
+    template<int WrapS>
+    void resolveWrapT(int wrapT, int filter, int mip);
+
+    // Byte offset of a texel in level.texels is texelColumn + texelRow, tiles and
+    // Morton order split into x and row bits, so the corners of a footprint share them.
+    static int texelColumn(int layout, int x) {
+        if (layout == LAYOUT_LINEAR)
+            return 4 * x;
+        int shift = tileShift(layout);
+        return 4 * (((x >> shift) << (shift * 2)) + mortonIndex(x & ((1 << shift) - 1), 0));
+    }
+
+    static int texelRow(int layout, const MipLevel &level, int row) {
+        if (layout == LAYOUT_LINEAR)
+            return 4 * row * level.width;
+        int shift = tileShift(layout);
+        return 4 * ((((row >> shift) * level.tilesX) << (shift * 2)) + mortonIndex(0, row & ((1 << shift) - 1)));
+    }
+
+    static int texelOffset(int layout, const MipLevel &level, int x, int row) {
+        return texelColumn(layout, x) + texelRow(layout, level, row);
+    }
+
+    Vec3 fetchColor(int x, int row) const;
+
+    // rgba texels of block (bx, by) of a compressed level, row by row, decoded through a small
+    // per thread cache. Valid until the next call that misses the same cache slot.
+    const unsigned char *decodedBlock(const MipLevel &level, int bx, int by) const;
+
+    int compressedTexel(const MipLevel &level, int x, int row) const;
+
+    template<bool Compressed>
+    __m128i bilinearTexel(const MipLevel &level, int iu, int iv, int fu, int fv) const;
+
+    template<bool Compressed>
+    __m128i bilinear(const MipLevel &level, float s, float t) const;
+
+    // rgb 0..255 of the lanes in mask, lane i filtered on level levels[i]
+    template<bool Compressed>
+    void bilinear(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const;
+
+    // the texel nearest to (s, t), unfiltered
+    template<bool Compressed>
+    __m128i point(const MipLevel &level, float s, float t) const;
+
+    template<bool Compressed>
+    void point(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const;
+
+    template<int Filter, bool Compressed>
+    __m128i filterLevel(const MipLevel &level, float s, float t) const;
+
+    template<int Filter, bool Compressed>
+    void filterLevels(const int *levels, Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f *channels) const;
+
+    // level of detail from the texel footprint of one pixel, squared and in level 0 texels
+    float levelOfDetail(float footprintSqr) const;
+
+    Sse::Vec4f levelOfDetail(Sse::Vec4f footprintSqr) const;
+
+    float fetchDepth(int x, int row) const;
+
+    // current size of the viewed target, read per lookup since the target may be resized
+    void targetSize(int &w, int &h) const;
+
+    // texel corners of PACKET_SIZE bilinear lookups in a w x h image and the weights of
+    // the next texel in u and v
+    static void footprint(int w, int h, Sse::Vec4f s, Sse::Vec4f t, int *iu, int *iv, int *uNext, int *vNext,
+                          Sse::Vec4f &uNextPer, Sse::Vec4f &vNextPer);
+
 public:
-    unsigned char *imgData;
+    unsigned char *imgData; //own level 0 texels in texelFormat, nullptr for render target views
 
     Sampler(int sw, int sh);
 
+    // texture of levels of format blocks back to back, as stored by a DDS file
+    Sampler(int sw, int sh, int format, int levels, const unsigned char *blocks);
+
+    // Views over render target memory, nothing is copied. They read the
+    // target at sampling time, so they stay valid across its resizes.
+    explicit Sampler(const FrameBuffer *fb);
+
+    // depth views return window depth 0..1 in every channel
+    explicit Sampler(const DepthBuffer *db);
+
     ~Sampler();
 
+    // Resolves state into the lookups of this sampler, once per draw rather than per
+    // sample. Texture samplers only, render target views always filter bilinearly.
+    void bindState(const SamplerState &samplerState);
+
+    const SamplerState &getState() const { return state; }
+
     Vec4 texture2D(float s, float t);
-};
 
-void writeFrameBuffer2Sampler(FrameBuffer *fb, Sampler *sampler);
+    // box filters the rgba texels into a full chain down to 1x1, texture samplers
+    // with linear texels only
+    void generateMipmaps();
+
+    // reorders every level into LAYOUT_LINEAR, LAYOUT_TILED4 or LAYOUT_TILED8 blocks with
+    // Morton order inside, so that both rows of a bilinear footprint mostly share cache lines.
+    // imgData is tiled afterwards as well.
+    void setTexelLayout(int layout);
+
+    int getTexelLayout() const { return texelLayout; }
+
+    // Encodes every level into TEXEL_BC1, TEXEL_BC4 or TEXEL_BC5 blocks and drops the rgba
+    // texels. Blocks stay compressed and are decoded on demand, texel layouts do not apply.
+    void compress(int format);
+
+    // replaces the texels with levels of blocks back to back, as stored by a DDS file
+    void setCompressedLevels(int format, int levels, const unsigned char *blocks);
+
+    int getTexelFormat() const { return texelFormat; }
+
+    const unsigned char *getLevelTexels(int level, int &levelWidth, int &levelHeight) const;
+
+    int getMipLevels() const { return mipLevels; }
+
+    // lod 0 is the full image, samplers without mipmaps always read level 0
+    Vec4 texture2DLod(float s, float t, float lod);
+
+    // lod from the change of s, t to the next pixel, as given by Fragment or dFdx and dFdy,
+    // plus the lodBias of the state
+    Vec4 texture2DGrad(float s, float t, float dsdx, float dtdx, float dsdy, float dtdy);
+
+    // depth views only: fraction of the 2x2 texels around (s, t) with reference <= stored
+    // window depth, bilinearly weighted
+    float textureCompare(float s, float t, float reference);
+
+    // packet versions of the lookups above, lanes outside mask are not fetched and return 0
+    void texture2D(Sse::Vec4f s, Sse::Vec4f t, int mask, Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue);
+
+    // count lookups, a multiple of PACKET_SIZE, with PACKET_SIZE results per channel vector
+    void texture2D(const float *s, const float *t, int count, Sse::Vec4f *red, Sse::Vec4f *green, Sse::Vec4f *blue);
+
+    Sse::Vec4f textureCompare(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f reference, int mask);
+
+    void texture2DLod(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f lod, int mask,
+                      Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue);
+
+    void texture2DGrad(Sse::Vec4f s, Sse::Vec4f t, Sse::Vec4f dsdx, Sse::Vec4f dtdx, Sse::Vec4f dsdy,
+                       Sse::Vec4f dtdy, int mask, Sse::Vec4f &red, Sse::Vec4f &green, Sse::Vec4f &blue);
+};
 
 #endif /* SAMPLER_H_ */
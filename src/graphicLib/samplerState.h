@@ -0,0 +1,21 @@
+#ifndef SAMPLERSTATE_H_
+#define SAMPLERSTATE_H_
+
+#include "../header/header.h"
+
+// How a texture is read: WRAP_* per axis, FILTER_* inside a level, MIP_* across
+// levels and a bias added to the lod of texture2DGrad. Sampler::bindState resolves
+// it into one specialized lookup, so samples do not branch on it.
+struct SamplerState {
+    int wrapS, wrapT;
+    int filter;
+    int mipFilter;
+    float lodBias;
+};
+
+const SamplerState samplerPoint = {WRAP_CLAMP, WRAP_CLAMP, FILTER_POINT, MIP_NONE, 0.0f};
+const SamplerState samplerBilinear = {WRAP_CLAMP, WRAP_CLAMP, FILTER_BILINEAR, MIP_NONE, 0.0f};
+const SamplerState samplerTrilinear = {WRAP_CLAMP, WRAP_CLAMP, FILTER_BILINEAR, MIP_LINEAR, 0.0f};
+const SamplerState samplerRepeat = {WRAP_REPEAT, WRAP_REPEAT, FILTER_BILINEAR, MIP_LINEAR, 0.0f};
+
+#endif /* SAMPLERSTATE_H_ */
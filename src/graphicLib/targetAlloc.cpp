@@ -0,0 +1,61 @@
+#include <string.h>
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif
+#include "targetAlloc.h"
+
+RENDER_LOCAL TargetPolicy targetPolicy;
+RENDER_LOCAL int targetAllocCount = 0;
+
+unsigned char *allocTarget(size_t size, size_t &capacity) {
+    size_t alignment = targetPolicy.alignment;
+    bool hugePages = targetPolicy.hugePages && size >= HUGE_PAGE_SIZE;
+    if (hugePages && alignment < HUGE_PAGE_SIZE)
+        alignment = HUGE_PAGE_SIZE;
+    capacity = (size + alignment - 1) & ~(alignment - 1);
+
+    void *memory = NULL;
+#ifdef _WIN32
+    // large pages need SeLockMemoryPrivilege on windows, aligned heap memory only
+    memory = _aligned_malloc(capacity, alignment);
+#else
+    if (posix_memalign(&memory, alignment, capacity) != 0)
+        memory = NULL;
+#ifdef MADV_HUGEPAGE
+    if (memory != NULL && hugePages)
+        madvise(memory, capacity, MADV_HUGEPAGE);
+#endif
+#endif
+    if (memory == NULL) {
+        capacity = 0;
+        return NULL;
+    }
+    memset(memory, 0, capacity);
+    targetAllocCount++;
+    return (unsigned char *) memory;
+}
+
+void freeTarget(unsigned char *memory) {
+    if (memory == NULL)
+        return;
+#ifdef _WIN32
+    _aligned_free(memory);
+#else
+    free(memory);
+#endif
+}
+
+void reserveTarget(unsigned char **memory, size_t &capacity, size_t size) {
+    if (*memory != NULL && targetPolicy.reuse && size <= capacity)
+        return;
+    size_t request = size;
+    if (*memory != NULL && targetPolicy.reuse)
+        request = (size_t) (size * targetPolicy.growth);
+    if (request < size)
+        request = size;
+    freeTarget(*memory);
+    *memory = allocTarget(request, capacity);
+}
@@ -0,0 +1,32 @@
+#ifndef TARGETALLOC_H_
+#define TARGETALLOC_H_
+
+#include <stddef.h>
+#include "../header/header.h"
+
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// How render target memory is allocated, see allocTarget/reserveTarget.
+struct TargetPolicy {
+    bool reuse; //keep the allocation when the new size fits its capacity
+    size_t alignment; //power of two, CACHE_LINE_SIZE or a page size
+    bool hugePages; //back targets of at least HUGE_PAGE_SIZE with huge pages where the os allows
+    float growth; //capacity factor when a reused target has to grow, absorbs window drags
+
+    TargetPolicy() : reuse(true), alignment(CACHE_LINE_SIZE), hugePages(false), growth(1.25f) {}
+};
+
+extern RENDER_LOCAL TargetPolicy targetPolicy;
+extern RENDER_LOCAL int targetAllocCount; //allocations made, to watch resize behaviour
+
+// zeroed memory of at least size bytes, capacity receives the real size
+unsigned char *allocTarget(size_t size, size_t &capacity);
+
+void freeTarget(unsigned char *memory);
+
+// makes *memory hold size bytes, reallocates only when the capacity is too small
+// or reuse is off. Old contents are not kept.
+void reserveTarget(unsigned char **memory, size_t &capacity, size_t size);
+
+#endif /* TARGETALLOC_H_ */
@@ -11,6 +11,68 @@
 #define CULL_NONE 2
 #define INV_SCALE 0.003921568627451f
 
+#define PIXEL_BGRA8 0 //32位 内存顺序b,g,r,a 与显示表面一致
+#define PIXEL_RGBA8 1
+#define PIXEL_RGB8 2 //24位 节省内存
+
+#define LAYOUT_LINEAR 0 //逐行存储
+#define LAYOUT_TILED8 1 //8x8分块 块内Morton顺序
+#define LAYOUT_TILED16 2 //16x16分块 块内Morton顺序
+#define LAYOUT_TILED4 3 //4x4分块 块内Morton顺序 仅用于纹理
+
+#define MSAA_SAMPLES 4 //多重采样 每像素4个采样点
+#define PACKET_SIZE 4 //SIMD着色 每包2x2个片元 对应SSE的4个通道
+
+#define VARYING_WORLD 1 //片元着色器读取的插值量 Clip和View总是保留
+#define VARYING_LIGHT 2
+#define VARYING_NORMAL 4
+#define VARYING_TEXCOORD 8 //s,t
+#define VARYING_ALL 15
+
+#define DEPTH_FLOAT32 0 //32位浮点 -1..1
+#define DEPTH_UNORM16 1 //16位定点 用于阴影等深度pass
+#define DEPTH_FIXED24 2 //24位定点 存于32位低24位
+#define DEPTH_FLOAT32_REV 3 //反向Z 近1远0 配合perspectiveReversed
+#define DEPTH_NONE -1 //无深度缓冲 仅用于光栅化变体
+
+#define DEPTH_TEST_LESS 0 //通过则写入深度
+#define DEPTH_TEST_EQUAL 1 //深度预pass之后 仅相等通过 不写深度
+
+#define LIGHT_TILE_SIZE 16 //延迟光照分块 每块按深度范围剔除光源
+#define SHADOW_NORMAL_OFFSET 0.2f //延迟光照查阴影前沿法线外移 背光坡越陡移得越多 防止自阴影
+
+#define MIP_NONE 0 //只采样第0级
+#define MIP_NEAREST 1 //最近的一级 双线性
+#define MIP_LINEAR 2 //相邻两级双线性再插值 即三线性
+#define MAX_MIP_LEVELS 16 //最大支持32768x32768
+
+#define WRAP_REPEAT 0 //纹理坐标寻址 取小数部分
+#define WRAP_CLAMP 1 //截断到0..1
+#define WRAP_MIRROR 2 //每个整数周期镜像一次
+
+#define FILTER_POINT 0 //最近的纹素
+#define FILTER_BILINEAR 1 //2x2纹素 配合MIP_LINEAR即三线性
+
+#define TEXEL_RGBA8 0 //每纹素4字节
+#define TEXEL_BC1 1 //4x4块8字节 rgb 两个565端点
+#define TEXEL_BC4 2 //4x4块8字节 单通道 采样为灰度
+#define TEXEL_BC5 3 //4x4块16字节 两个BC4通道 采样为rg 常用于法线贴图
+
+#define BLEND_ZERO 0 //混合因子 帧缓冲没有alpha 只能读源alpha
+#define BLEND_ONE 1
+#define BLEND_SRC_COLOR 2
+#define BLEND_ONE_MINUS_SRC_COLOR 3
+#define BLEND_SRC_ALPHA 4
+#define BLEND_ONE_MINUS_SRC_ALPHA 5
+#define BLEND_DST_COLOR 6
+#define BLEND_ONE_MINUS_DST_COLOR 7
+
+#define BLEND_OP_ADD 0 //src*srcFactor op dst*dstFactor
+#define BLEND_OP_SUBTRACT 1
+#define BLEND_OP_REVERSE_SUBTRACT 2
+#define BLEND_OP_MIN 3 //MIN和MAX忽略因子
+#define BLEND_OP_MAX 4
+
 #define NONE 0
 #define LEFT 1
 #define RIGHT 2
@@ -1,15 +1,138 @@
 #pragma once
 
 #include "Maths/Vec4.h"
+#include "constants.h"
 
 struct FrameBuffer {
     unsigned char *colorBuffer;
     int width, height;
+    int format;
+    int stride; //bytes per row, linear layout only
+    bool external; //colorBuffer belongs to a presenter surface
+    size_t capacity; //bytes of the owned allocation, reused by resizes
+    int layout, tilesX, tilesY;
+    int samples; //1 or MSAA_SAMPLES
+    unsigned int *sampleColors; //MSAA_SAMPLES packed colors per pixel, valid where sampleExpanded is set
+    unsigned char *sampleExpanded; //per pixel, 0 while one color in colorBuffer stands for all samples
+    size_t sampleCapacity, expandedCapacity;
 };
 
+inline int pixelSize(int format) { return format == PIXEL_RGB8 ? 3 : 4; }
+
+inline int tileShift(int layout) { return layout == LAYOUT_TILED4 ? 2 : layout == LAYOUT_TILED8 ? 3 : 4; }
+
+// interleave the bits of two 4 bit coordinates
+inline int mortonIndex(int x, int y) {
+    x = (x | (x << 2)) & 0x33;
+    x = (x | (x << 1)) & 0x55;
+    y = (y | (y << 2)) & 0x33;
+    y = (y | (y << 1)) & 0x55;
+    return x | (y << 1);
+}
+
+// element index of (x, row) in a tiled buffer
+inline int tiledIndex(int layout, int tilesX, int x, int row) {
+    int shift = tileShift(layout);
+    int mask = (1 << shift) - 1;
+    int tile = (row >> shift) * tilesX + (x >> shift);
+    return (tile << (shift * 2)) + mortonIndex(x & mask, row & mask);
+}
+
+// byte offset of (x, row), row 0 is the top of the image
+inline int pixelOffset(const FrameBuffer *fb, int x, int row) {
+    if (fb->layout == LAYOUT_LINEAR)
+        return row * fb->stride + x * pixelSize(fb->format);
+    return tiledIndex(fb->layout, fb->tilesX, x, row) * pixelSize(fb->format);
+}
+
+// element index of (x, row) ignoring the stride, for per pixel side buffers
+inline int pixelIndex(const FrameBuffer *fb, int x, int row) {
+    if (fb->layout == LAYOUT_LINEAR)
+        return row * fb->width + x;
+    return tiledIndex(fb->layout, fb->tilesX, x, row);
+}
+
+inline unsigned int packPixel(int format, unsigned char r, unsigned char g, unsigned char b) {
+    if (format == PIXEL_RGBA8)
+        return r | (g << 8) | (b << 16) | 0xff000000u;
+    return b | (g << 8) | (r << 16) | 0xff000000u;
+}
+
+inline void unpackPixel(int format, unsigned int pixel, unsigned char &r, unsigned char &g, unsigned char &b) {
+    if (format == PIXEL_RGBA8) {
+        r = pixel & 0xff;
+        b = (pixel >> 16) & 0xff;
+    } else {
+        b = pixel & 0xff;
+        r = (pixel >> 16) & 0xff;
+    }
+    g = (pixel >> 8) & 0xff;
+}
+
+inline void storePixel(FrameBuffer *fb, int x, int row, unsigned char r, unsigned char g, unsigned char b) {
+    int index = pixelOffset(fb, x, row);
+    if (fb->format != PIXEL_RGB8) {
+        *(unsigned int *) (fb->colorBuffer + index) = packPixel(fb->format, r, g, b);
+        return;
+    }
+    fb->colorBuffer[index] = r;
+    fb->colorBuffer[index + 1] = g;
+    fb->colorBuffer[index + 2] = b;
+}
+
+inline void loadPixel(const FrameBuffer *fb, int x, int row, unsigned char &r, unsigned char &g, unsigned char &b) {
+    int index = pixelOffset(fb, x, row);
+    if (fb->format != PIXEL_RGB8) {
+        unpackPixel(fb->format, *(const unsigned int *) (fb->colorBuffer + index), r, g, b);
+        return;
+    }
+    r = fb->colorBuffer[index];
+    g = fb->colorBuffer[index + 1];
+    b = fb->colorBuffer[index + 2];
+}
+
+// pixel as packPixel lays it out, PIXEL_RGB8 included
+inline unsigned int loadPacked(const FrameBuffer *fb, int x, int row) {
+    int index = pixelOffset(fb, x, row);
+    if (fb->format != PIXEL_RGB8)
+        return *(const unsigned int *) (fb->colorBuffer + index);
+    return packPixel(fb->format, fb->colorBuffer[index], fb->colorBuffer[index + 1], fb->colorBuffer[index + 2]);
+}
+
+inline void storePacked(FrameBuffer *fb, int x, int row, unsigned int pixel) {
+    int index = pixelOffset(fb, x, row);
+    if (fb->format != PIXEL_RGB8) {
+        *(unsigned int *) (fb->colorBuffer + index) = pixel;
+        return;
+    }
+    unpackPixel(fb->format, pixel, fb->colorBuffer[index], fb->colorBuffer[index + 1], fb->colorBuffer[index + 2]);
+}
+
 struct DepthBuffer {
-    float *depthBuffer;
+    unsigned char *depthBuffer; //elements of depthSize(format) bytes
     int width, height;
+    int format;
+    int samples; //depth values per pixel, stored next to each other
+    size_t capacity;
+    int layout, tilesX, tilesY;
+};
+
+inline int depthSize(int format) { return format == DEPTH_UNORM16 ? 2 : 4; }
+
+inline int depthIndex(const DepthBuffer *db, int x, int row) {
+    if (db->layout == LAYOUT_LINEAR)
+        return row * db->width + x;
+    return tiledIndex(db->layout, db->tilesX, x, row);
+}
+
+struct Rect {
+    int minX, minY, maxX, maxY;
+
+    Rect() : minX(0), minY(0), maxX(-1), maxY(-1) {}
+
+    Rect(int x0, int y0, int x1, int y1) : minX(x0), minY(y0), maxX(x1), maxY(y1) {}
+
+    bool empty() const { return maxX < minX || maxY < minY; }
 };
 
 struct Vertex {
@@ -31,12 +154,14 @@ struct VertexOut {
     Vec4 Clip;
     Vec4 World;
     Vec4 View;
+    Vec4 Light; //shadow map coordinates
     Vec3 Normal;
     float s, t;
 
     VertexOut() : Clip(0, 0, 0, 1),
                   World(0, 0, 0, 1),
                   View(0, 0, 0, 1),
+                  Light(0, 0, 0, 1),
                   Normal(0, 0, 0),
                   s(0), t(0) {}
 };
@@ -44,24 +169,59 @@ struct VertexOut {
 struct Fragment {
     union { struct { float ndcX, ndcY, ndcZ; }; Vec3 Ndc; };
     Vec4 World;
+    Vec4 Light;
     Vec3 Normal;
     float s, t;
+    float dsdx, dtdx, dsdy, dtdy; //change of s, t to the next pixel in x and y
 
     Fragment() : ndcX(0), ndcY(0), ndcZ(1),
                  World(0, 0, 0, 1),
+                 Light(0, 0, 0, 1),
                  Normal(0, 0, 0),
-                 s(0), t(0) {}
+                 s(0), t(0),
+                 dsdx(0), dtdx(0), dsdy(0), dtdy(0) {}
 };
 
 struct FragmentOut {
     Vec4 Color;
+    Vec4 Color1; //of secondTarget, by shaders registered for two targets
 
-    FragmentOut() : Color(0, 0, 0, 1) {}
+    FragmentOut() : Color(0, 0, 0, 1), Color1(0, 0, 0, 1) {}
+};
+
+// PACKET_SIZE fragments of a 2x2 quad in SoA form, lane i is bit i of mask:
+// 0 (x, y), 1 (x + 1, y), 2 (x, y + 1), 3 (x + 1, y + 1).
+// Lanes outside mask are helper lanes, their varyings are interpolated as well
+// so that dFdx and dFdy hold in every lane.
+struct FragmentPacket {
+    Sse::Vec4f ndcX, ndcY, ndcZ;
+    Sse::Vec4f worldX, worldY, worldZ, worldW;
+    Sse::Vec4f lightX, lightY, lightZ, lightW;
+    Sse::Vec4f normalX, normalY, normalZ;
+    Sse::Vec4f s, t;
+    int mask;
+};
+
+// differences across the quad of any per lane value: right minus left per row,
+// upper minus lower row per column
+inline Sse::Vec4f dFdx(Sse::Vec4f v) noexcept {
+    return v.shuffle<3, 3, 1, 1>() - v.shuffle<2, 2, 0, 0>();
+}
+
+inline Sse::Vec4f dFdy(Sse::Vec4f v) noexcept {
+    return v.shuffle<3, 2, 3, 2>() - v.shuffle<1, 0, 1, 0>();
+}
+
+struct FragmentPacketOut {
+    Sse::Vec4f red, green, blue, alpha;
 };
 
 using VertexShader = void (*)(const Vertex &input, VertexOut &output) noexcept;
 
 using FragmentShader = void (*)(const Fragment &input, FragmentOut &output) noexcept;
 
+// shades a packet, the output of helper lanes is discarded. Texture fetches can skip them.
+using PacketShader = void (*)(const FragmentPacket &input, FragmentPacketOut &output) noexcept;
+
 using DrawCall = void (*)();
 
@@ -8,6 +8,10 @@
 #include "datatype.h"
 #include "../util/util.h"
 
+// Mutable renderer state (matrices, uniforms, targets, scene objects).
+// Every rendering thread works on its own copy, see batch.cpp.
+#define RENDER_LOCAL thread_local
+
 #ifndef max
 #define max(a, b) ((a)>(b)?(a):(b))
 #endif
@@ -0,0 +1,209 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "frame.h"
+#include "objects.h"
+#include "presenter/memoryPresenter.h"
+
+// Offscreen entry point for machines without a display:
+// renders a number of frames at the requested resolution and reports fps.
+void printUsage() {
+    std::cout << "usage: RendererHeadless [--width W] [--height H] [--frames N] [--format bgra|rgba|rgb]"
+                 " [--layout linear|tiled8|tiled16]"
+                 " [--depth float|unorm16|fixed24|reversed] [--msaa] [--arena-stats] [--generic-raster]"
+                 " [--prepass] [--deferred] [--lights N] [--light-threads N] [--pass-stats]"
+                 " [--sphere-blend alpha|premultiplied|additive|multiply|min|max] [--mip none|nearest|trilinear]"
+                 " [--texture-filter point|bilinear] [--texture-wrap clamp|repeat|mirror] [--lod-bias B]"
+                 " [--texture-layout linear|tiled4|tiled8] [--texture-format rgba8|bc1|bc4|bc5]"
+                 " [--output file.bmp]" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int width = SCREEN_WIDTH;
+    int height = SCREEN_HEIGHT;
+    int frames = 100;
+    const char *output = nullptr;
+    bool passStatsFlag = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--arena-stats")
+            arenaStatsFlag = true;
+        else if (arg == "--generic-raster")
+            rasterVariantFlag = false;
+        else if (arg == "--prepass")
+            prepassFlag = true;
+        else if (arg == "--deferred")
+            deferredFlag = true;
+        else if (i + 1 < argc && arg == "--lights")
+            deferredLightNum = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--light-threads")
+            lightingThreads = atoi(argv[++i]);
+        else if (arg == "--pass-stats")
+            passStatsFlag = true;
+        else if (arg == "--msaa")
+            frameSamples = MSAA_SAMPLES;
+        else if (i + 1 < argc && arg == "--width")
+            width = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--height")
+            height = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--frames")
+            frames = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--format") {
+            std::string format = argv[++i];
+            if (format == "bgra")
+                framePixelFormat = PIXEL_BGRA8;
+            else if (format == "rgba")
+                framePixelFormat = PIXEL_RGBA8;
+            else if (format == "rgb")
+                framePixelFormat = PIXEL_RGB8;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--layout") {
+            std::string layout = argv[++i];
+            if (layout == "linear")
+                frameLayout = LAYOUT_LINEAR;
+            else if (layout == "tiled8")
+                frameLayout = LAYOUT_TILED8;
+            else if (layout == "tiled16")
+                frameLayout = LAYOUT_TILED16;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--depth") {
+            std::string depth = argv[++i];
+            if (depth == "float")
+                frameDepthFormat = DEPTH_FLOAT32;
+            else if (depth == "unorm16")
+                frameDepthFormat = DEPTH_UNORM16;
+            else if (depth == "fixed24")
+                frameDepthFormat = DEPTH_FIXED24;
+            else if (depth == "reversed")
+                frameDepthFormat = DEPTH_FLOAT32_REV;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--sphere-blend") {
+            std::string mode = argv[++i];
+            if (mode == "alpha")
+                sphereBlend = blendAlpha;
+            else if (mode == "premultiplied")
+                sphereBlend = blendPremultiplied;
+            else if (mode == "additive")
+                sphereBlend = blendAdditive;
+            else if (mode == "multiply")
+                sphereBlend = blendMultiply;
+            else if (mode == "min")
+                sphereBlend = blendMin;
+            else if (mode == "max")
+                sphereBlend = blendMax;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--mip") {
+            std::string mode = argv[++i];
+            if (mode == "none")
+                textureSampler.mipFilter = MIP_NONE;
+            else if (mode == "nearest")
+                textureSampler.mipFilter = MIP_NEAREST;
+            else if (mode == "trilinear")
+                textureSampler.mipFilter = MIP_LINEAR;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--texture-filter") {
+            std::string filter = argv[++i];
+            if (filter == "point")
+                textureSampler.filter = FILTER_POINT;
+            else if (filter == "bilinear")
+                textureSampler.filter = FILTER_BILINEAR;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--texture-wrap") {
+            std::string wrap = argv[++i];
+            if (wrap == "clamp")
+                textureSampler.wrapS = textureSampler.wrapT = WRAP_CLAMP;
+            else if (wrap == "repeat")
+                textureSampler.wrapS = textureSampler.wrapT = WRAP_REPEAT;
+            else if (wrap == "mirror")
+                textureSampler.wrapS = textureSampler.wrapT = WRAP_MIRROR;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--lod-bias")
+            textureSampler.lodBias = (float) atof(argv[++i]);
+        else if (i + 1 < argc && arg == "--texture-layout") {
+            std::string layout = argv[++i];
+            if (layout == "linear")
+                textureLayout = LAYOUT_LINEAR;
+            else if (layout == "tiled4")
+                textureLayout = LAYOUT_TILED4;
+            else if (layout == "tiled8")
+                textureLayout = LAYOUT_TILED8;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--texture-format") {
+            std::string format = argv[++i];
+            if (format == "rgba8")
+                textureFormat = TEXEL_RGBA8;
+            else if (format == "bc1")
+                textureFormat = TEXEL_BC1;
+            else if (format == "bc4")
+                textureFormat = TEXEL_BC4;
+            else if (format == "bc5")
+                textureFormat = TEXEL_BC5;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (i + 1 < argc && arg == "--output")
+            output = argv[++i];
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (width <= 0 || height <= 0 || frames <= 0 || deferredLightNum < 0) {
+        printUsage();
+        return 1;
+    }
+
+    MemoryPresenter *memoryPresenter = new MemoryPresenter();
+    presenter = memoryPresenter;
+    init();
+    resize(width, height);
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+        draw();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << frames << " frames at " << width << "x" << height << " in " << elapsed.count() << " s, "
+              << frames / elapsed.count() << " fps, "
+              << elapsed.count() * 1000.0 / frames << " ms/frame" << std::endl;
+    if (passStatsFlag)
+        std::cout << "per frame: " << passStats.shadedFragments / passStats.frames << " shaded fragments, "
+                  << passStats.prepassFragments / passStats.frames << " prepass fragments, "
+                  << passStats.prepassSeconds * 1000.0 / passStats.frames << " ms prepass, "
+                  << passStats.lightEvaluations / passStats.frames << " light evaluations, "
+                  << passStats.lightingSeconds * 1000.0 / passStats.frames << " ms lighting" << std::endl;
+
+    if (output != nullptr)
+        memoryPresenter->save(output);
+
+    release();
+    presenter = nullptr;
+    delete memoryPresenter;
+    return 0;
+}
@@ -1,8 +1,8 @@
 #include "key.h"
 
-bool *turn = NULL;
-bool *move = NULL;
-bool willExit = false;
+RENDER_LOCAL bool *turn = NULL;
+RENDER_LOCAL bool *move = NULL;
+RENDER_LOCAL bool willExit = false;
 
 void initKeys() {
     turn = new bool[4];
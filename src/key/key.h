@@ -12,9 +12,9 @@
 #define VK_DOWN        40
 #endif
 
-extern bool *turn;
-extern bool *move;
-extern bool willExit;
+extern RENDER_LOCAL bool *turn;
+extern RENDER_LOCAL bool *move;
+extern RENDER_LOCAL bool willExit;
 
 void initKeys();
 
@@ -1,38 +1,17 @@
 #include <windows.h>
 #include "frame.h"
+#include "presenter/win32Presenter.h"
 #include <chrono>
 #include <iostream>
 
 LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
 const TCHAR szName[] = TEXT("win");
-HDC hdc, dibDC;
-HBITMAP screenDIB = NULL, dibBefore;
-int swidth, sheight;
+HDC hdc;
+Win32Presenter *windowPresenter = NULL;
 BOOL mode256 = false;
 HPALETTE hPalette = NULL;
 
-void initDIB(HDC dibDC, int width, int height) {
-    BITMAPINFO bmi;
-    memset(&bmi, 0, sizeof(bmi));
-    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
-    bmi.bmiHeader.biWidth = width;
-    bmi.bmiHeader.biHeight = -height;
-    bmi.bmiHeader.biPlanes = 1;
-    bmi.bmiHeader.biBitCount = 24;
-    bmi.bmiHeader.biCompression = BI_RGB;
-    screenDIB = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **) &screenBits, NULL, 0);
-    dibBefore = (HBITMAP) SelectObject(dibDC, screenDIB);
-}
-
-void releaseDIB(HDC dibDC) {
-    if (screenDIB != NULL) {
-        SelectObject(dibDC, dibBefore);
-        DeleteObject(screenDIB);
-        screenDIB = NULL;
-    }
-}
-
 void checkDisplayMode(HDC hdc) {
     int palSize = GetDeviceCaps(hdc, SIZEPALETTE);
     if (palSize == 256)
@@ -116,9 +95,8 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
     hdc = GetDC(hWnd);
     checkDisplayMode(hdc);
     createPalette(hdc);
-    dibDC = CreateCompatibleDC(hdc);
-    swidth = SCREEN_WIDTH;
-    sheight = SCREEN_HEIGHT;
+    windowPresenter = new Win32Presenter(hdc);
+    presenter = windowPresenter;
     init();
 
     ShowWindow(hWnd, iCmdShow);
@@ -151,14 +129,13 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
         } else {
             runWindow();
             draw();
-            BitBlt(hdc, 0, 0, swidth, sheight, dibDC, 0, 0, SRCCOPY);
             fps();
         }
     }
 
     releasePalette();
-    releaseDIB(dibDC);
-    DeleteDC(dibDC);
+    presenter = NULL;
+    delete windowPresenter;
     ReleaseDC(hWnd, hdc);
     killWindow(hWnd, hInstance, wndClass);
     return msg.wParam;
@@ -167,11 +144,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR szCmdLine,
 LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
         case WM_SIZE:
-            swidth = LOWORD(lParam);
-            sheight = HIWORD(lParam);
             resize(LOWORD(lParam), HIWORD(lParam));
-            releaseDIB(dibDC);
-            initDIB(dibDC, LOWORD(lParam), HIWORD(lParam));
             InvalidateRect(hWnd, NULL, FALSE);
             break;
         case WM_KEYDOWN:
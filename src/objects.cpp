@@ -1,10 +1,12 @@
 #include "objects.h"
 
-Texture *texWood;
-Texture *texGround;
-Cube *cube;
-Square *square;
-Sphere *sphere;
+RENDER_LOCAL Texture *texWood;
+RENDER_LOCAL Texture *texGround;
+RENDER_LOCAL Cube *cube;
+RENDER_LOCAL Square *square;
+RENDER_LOCAL Sphere *sphere;
+RENDER_LOCAL BlendState sphereBlend = blendOpaque;
+RENDER_LOCAL SamplerState textureSampler = samplerTrilinear;
 
 void initUniforms() {
     lightDir.x = -2.0;
@@ -27,6 +29,24 @@ void initUniforms() {
     diffMat.y = 0.7;
     diffMat.z = 0.7;
     diffMat.w = 1.0;
+    uniformUpdate = updateUniformBlock;
+    prepassVertShader = positionVertShader;
+}
+
+// shades mesh with fs, or writes its albedo, normal and depth into gbuffer in one
+// draw of gbufferShader during the deferred geometry pass
+template<class Mesh>
+void renderMesh(Mesh *mesh, FragmentShader fs, FragmentShader gbufferShader) {
+    if (!deferredPass) {
+        mesh->render(frontBuffer, depthBuffer, vertexShader, fs, CULL_BACK);
+        return;
+    }
+    BlendState blending = blendState;
+    blendState = blendOpaque;
+    secondTarget = gbuffer.normal;
+    mesh->render(gbuffer.albedo, depthBuffer, vertexShader, gbufferShader, CULL_BACK);
+    secondTarget = nullptr;
+    blendState = blending;
 }
 
 void initCube() {
@@ -43,8 +63,8 @@ void renderCube() {
     Mat44 transMat = translate(0, 1, 0);
     Mat44 scaleMat = scale(1);
     modelMatrix = rotMat * transMat * scaleMat;
-    currTexture = texWood->sampler;
-    cube->render(frontBuffer, depthBuffer, vertexShader, fragmentShader, CULL_BACK);
+    bindTexture(texWood->sampler, textureSampler);
+    renderMesh(cube, flatFragmentShader, gbufferFragShader);
 }
 
 void renderCubeShadow() {
@@ -53,7 +73,7 @@ void renderCubeShadow() {
     Mat44 transMat = translate(0, 1, 0);
     Mat44 scaleMat = scale(1);
     modelMatrix = rotMat * transMat * scaleMat;
-    cube->render(shadowFrame, shadowDepth, storeVertShader, storeFragShader, CULL_FRONT);
+    castShadow(modelMatrix, cube->verts, cube->getFaceNum(), cube->revision);
 }
 
 void initSquare() {
@@ -69,8 +89,8 @@ void renderSquare() {
     Mat44 transMat = translate(0, 0, 0);
     Mat44 scaleMat = scale(50);
     modelMatrix = transMat * scaleMat;
-    currTexture = texGround->sampler;
-    square->render(frontBuffer, depthBuffer, vertexShader, fragmentShader, CULL_BACK);
+    bindTexture(texGround->sampler, textureSampler);
+    renderMesh(square, flatFragmentShader, gbufferFragShader);
 }
 
 void initSphere() {
@@ -82,20 +102,20 @@ void releaseSphere() {
 }
 
 void renderSphere() {
-    //blendFlag=true;
+    blendState = sphereBlend;
     modelMatrix.LoadIdentity();
     Mat44 transMat = translate(-2, 3, 2);
     modelMatrix = transMat;
-    currTexture = texGround->sampler;
-    sphere->render(frontBuffer, depthBuffer, vertexShader, simpleFragShader, CULL_BACK);
-    //blendFlag=false;
+    bindTexture(texGround->sampler, textureSampler);
+    renderMesh(sphere, simpleFragShader, simpleGBufferFragShader);
+    blendState = blendOpaque;
 }
 
 void renderSphereShadow() {
     modelMatrix.LoadIdentity();
     Mat44 transMat = translate(-2, 3, 2);
     modelMatrix = transMat;
-    sphere->render(shadowFrame, shadowDepth, storeVertShader, storeFragShader, CULL_FRONT);
+    castShadow(modelMatrix, sphere->verts, sphere->getFaceNum(), sphere->revision);
 }
 
 void renderShadow() {
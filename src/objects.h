@@ -7,12 +7,17 @@
 #include "cube/cube.h"
 #include "square/square.h"
 #include "sphere/sphere.h"
-
-extern Texture *texWood;
-extern Texture *texGround;
-extern Cube *cube;
-extern Square *square;
-extern Sphere *sphere;
+#include "deferred/deferred.h"
+
+extern RENDER_LOCAL Texture *texWood;
+extern RENDER_LOCAL Texture *texGround;
+extern RENDER_LOCAL Cube *cube;
+extern RENDER_LOCAL Square *square;
+extern RENDER_LOCAL Sphere *sphere;
+// blendOpaque by default, simpleFragShader gives it an alpha of 0.6
+extern RENDER_LOCAL BlendState sphereBlend;
+// sampler state of the textured objects, samplerTrilinear by default
+extern RENDER_LOCAL SamplerState textureSampler;
 
 void initUniforms();
 
@@ -0,0 +1,50 @@
+#include "memoryPresenter.h"
+#include "../texture/BmpLoader.h"
+#include "../graphicLib/targetAlloc.h"
+
+MemoryPresenter::MemoryPresenter() {
+    bits[0] = nullptr;
+    bits[1] = nullptr;
+    capacity[0] = 0;
+    capacity[1] = 0;
+    shown = 0;
+    width = 0;
+    height = 0;
+    frames = 0;
+}
+
+MemoryPresenter::~MemoryPresenter() {
+    freeTarget(bits[0]);
+    freeTarget(bits[1]);
+}
+
+void MemoryPresenter::resize(int w, int h) {
+    width = w;
+    height = h;
+    shown = 0;
+    for (int i = 0; i < 2; i++)
+        reserveTarget(&bits[i], capacity[i], width * height * 4);
+}
+
+int MemoryPresenter::getSurfaces(Surface *surfaces) {
+    for (int i = 0; i < 2; i++) {
+        surfaces[i].pixels = bits[i];
+        surfaces[i].stride = width * 4;
+        surfaces[i].format = PIXEL_BGRA8;
+    }
+    return 2;
+}
+
+void MemoryPresenter::present(const FrameBuffer *fb) {
+    if (fb->width != width || fb->height != height)
+        return;
+    if (fb->colorBuffer == bits[0] || fb->colorBuffer == bits[1])
+        shown = fb->colorBuffer == bits[0] ? 0 : 1;
+    else
+        copyFrameBuffer(fb, bits[shown], width * 4, PIXEL_BGRA8);
+    frames++;
+}
+
+bool MemoryPresenter::save(const char *fileName) const {
+    return saveBitmap(fileName, bits[shown], width, height, 4);
+}
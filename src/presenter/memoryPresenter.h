@@ -0,0 +1,32 @@
+#ifndef MEMORY_PRESENTER_H_
+#define MEMORY_PRESENTER_H_
+
+#include "presenter.h"
+
+// Offscreen presenter with two bgra surfaces the renderer draws into,
+// used by the headless build. present() only flips the shown surface.
+class MemoryPresenter : public Presenter {
+private:
+    unsigned char *bits[2];
+    size_t capacity[2];
+    int shown;
+    int width, height;
+public:
+    int frames;
+
+    MemoryPresenter();
+
+    ~MemoryPresenter();
+
+    void resize(int width, int height) override;
+
+    int getSurfaces(Surface *surfaces) override;
+
+    void present(const FrameBuffer *fb) override;
+
+    const unsigned char *getBits() const { return bits[shown]; }
+
+    bool save(const char *fileName) const;
+};
+
+#endif /* MEMORY_PRESENTER_H_ */
@@ -0,0 +1,80 @@
+#include <vector>
+#include <tmmintrin.h>
+#include "presenter.h"
+#include "../graphicLib/graphicLib.h"
+
+// byte order in memory, index of r, g, b
+int channelOffset(int format, int channel) {
+    if (format == PIXEL_BGRA8)
+        return 2 - channel;
+    return channel;
+}
+
+// pshufb mask moving 4 pixels from srcFormat to dstFormat, unused bytes cleared
+__m128i swizzleMask(int srcFormat, int dstFormat) {
+    alignas(16) char mask[16];
+    int srcSize = pixelSize(srcFormat);
+    int dstSize = pixelSize(dstFormat);
+    memset(mask, -1, sizeof(mask));
+    for (int p = 0; p < 4; p++) {
+        for (int c = 0; c < 3; c++)
+            mask[p * dstSize + channelOffset(dstFormat, c)] = (char) (p * srcSize + channelOffset(srcFormat, c));
+    }
+    return _mm_load_si128((const __m128i *) mask);
+}
+
+void convertRow(const unsigned char *src, int srcFormat, unsigned char *dst, int dstFormat, int width) {
+    int srcSize = pixelSize(srcFormat);
+    int dstSize = pixelSize(dstFormat);
+    const __m128i mask = swizzleMask(srcFormat, dstFormat);
+    const __m128i alpha = dstSize == 4 ? _mm_set1_epi32((int) 0xff000000) : _mm_setzero_si128();
+    int j = 0;
+    // 16 byte loads/stores, stop early when a 3 byte side would run past the row
+    int simdEnd = (srcSize == 3 || dstSize == 3) ? width - 5 : width - 3;
+    for (; j < simdEnd; j += 4) {
+        __m128i pixels = _mm_loadu_si128((const __m128i *) (src + j * srcSize));
+        pixels = _mm_or_si128(_mm_shuffle_epi8(pixels, mask), alpha);
+        _mm_storeu_si128((__m128i *) (dst + j * dstSize), pixels);
+    }
+    for (; j < width; j++) {
+        const unsigned char *s = src + j * srcSize;
+        unsigned char *d = dst + j * dstSize;
+        for (int c = 0; c < 3; c++)
+            d[channelOffset(dstFormat, c)] = s[channelOffset(srcFormat, c)];
+        if (dstSize == 4)
+            d[3] = 255;
+    }
+}
+
+void copyFrameBuffer(const FrameBuffer *fb, unsigned char *dst, int dstStride, int dstFormat) {
+    if (fb->layout != LAYOUT_LINEAR && fb->format == dstFormat && pixelSize(fb->format) == 4) {
+        readFrameBufferTiles(fb, dst, dstStride);
+        return;
+    }
+    if (fb->layout != LAYOUT_LINEAR) {
+        // detile one row at a time, then convert in place when the formats differ
+        std::vector<unsigned char> row(fb->width * pixelSize(fb->format) + 16);
+        for (int i = 0; i < fb->height; i++) {
+            if (fb->format == dstFormat) {
+                readFrameBufferRow(fb, i, 0, fb->width - 1, dst + i * dstStride);
+                continue;
+            }
+            readFrameBufferRow(fb, i, 0, fb->width - 1, row.data());
+            convertRow(row.data(), fb->format, dst + i * dstStride, dstFormat, fb->width);
+        }
+        return;
+    }
+    if (fb->format == dstFormat) {
+        int rowSize = fb->width * pixelSize(fb->format);
+        if (fb->stride == dstStride && rowSize == dstStride) {
+            memcpy(dst, fb->colorBuffer, dstStride * fb->height);
+            return;
+        }
+        for (int i = 0; i < fb->height; i++)
+            memcpy(dst + i * dstStride, fb->colorBuffer + i * fb->stride, rowSize);
+        return;
+    }
+
+    for (int i = 0; i < fb->height; i++)
+        convertRow(fb->colorBuffer + i * fb->stride, fb->format, dst + i * dstStride, dstFormat, fb->width);
+}
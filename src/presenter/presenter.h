@@ -0,0 +1,32 @@
+#ifndef PRESENTER_H_
+#define PRESENTER_H_
+
+#include "../header/header.h"
+
+// Memory the renderer may rasterize into directly.
+struct Surface {
+    unsigned char *pixels;
+    int stride, format;
+};
+
+// Destination of finished frames. swapBuffer()/flush() hand the front
+// buffer to the active presenter, which owns the presentation surface.
+class Presenter {
+public:
+    virtual ~Presenter() {}
+
+    virtual void resize(int width, int height) = 0;
+
+    // Surfaces (at most 2) valid since the last resize. With two of a matching format
+    // the front and back buffers are placed on them, so present() needs no copy.
+    virtual int getSurfaces(Surface * /*surfaces*/) { return 0; }
+
+    virtual void present(const FrameBuffer *fb) = 0;
+};
+
+// framebuffer to surface rows in dstFormat, dstStride in bytes.
+// A plain memcpy when the formats match, a pshufb swizzle otherwise,
+// tiled framebuffers are detiled row by row.
+void copyFrameBuffer(const FrameBuffer *fb, unsigned char *dst, int dstStride, int dstFormat);
+
+#endif /* PRESENTER_H_ */
@@ -0,0 +1,83 @@
+#include "win32Presenter.h"
+
+Win32Presenter::Win32Presenter(HDC windowDC) {
+    hdc = windowDC;
+    dibDC = CreateCompatibleDC(hdc);
+    dibs[0] = dibs[1] = NULL;
+    dibBefore = NULL;
+    dibBits[0] = dibBits[1] = NULL;
+    selected = 0;
+    width = 0;
+    height = 0;
+    dibWidth = 0;
+    dibHeight = 0;
+    stride = 0;
+}
+
+Win32Presenter::~Win32Presenter() {
+    releaseDIB();
+    DeleteDC(dibDC);
+}
+
+void Win32Presenter::initDIB() {
+    BITMAPINFO bmi;
+    memset(&bmi, 0, sizeof(bmi));
+    bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+    bmi.bmiHeader.biWidth = dibWidth;
+    bmi.bmiHeader.biHeight = -dibHeight;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+    for (int i = 0; i < 2; i++)
+        dibs[i] = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void **) &dibBits[i], NULL, 0);
+    selected = 0;
+    dibBefore = (HBITMAP) SelectObject(dibDC, dibs[0]);
+}
+
+void Win32Presenter::releaseDIB() {
+    if (dibs[0] != NULL)
+        SelectObject(dibDC, dibBefore);
+    for (int i = 0; i < 2; i++) {
+        if (dibs[i] != NULL)
+            DeleteObject(dibs[i]);
+        dibs[i] = NULL;
+        dibBits[i] = NULL;
+    }
+}
+
+void Win32Presenter::resize(int w, int h) {
+    width = w;
+    height = h;
+    if (dibs[0] != NULL && width <= dibWidth && height <= dibHeight)
+        return;
+    // grow only, a smaller window keeps the sections and uses their top left part
+    dibWidth = max(dibWidth, width);
+    dibHeight = max(dibHeight, height);
+    stride = dibWidth * 4;
+    releaseDIB();
+    initDIB();
+}
+
+int Win32Presenter::getSurfaces(Surface *surfaces) {
+    if (dibBits[0] == NULL || dibBits[1] == NULL)
+        return 0;
+    for (int i = 0; i < 2; i++) {
+        surfaces[i].pixels = dibBits[i];
+        surfaces[i].stride = stride;
+        surfaces[i].format = PIXEL_BGRA8;
+    }
+    return 2;
+}
+
+void Win32Presenter::present(const FrameBuffer *fb) {
+    if (dibBits[0] == NULL || fb->width != width || fb->height != height)
+        return;
+    int shown = fb->colorBuffer == dibBits[1] ? 1 : 0;
+    if (fb->colorBuffer != dibBits[shown])
+        copyFrameBuffer(fb, dibBits[shown], stride, PIXEL_BGRA8);
+    if (shown != selected) {
+        SelectObject(dibDC, dibs[shown]);
+        selected = shown;
+    }
+    BitBlt(hdc, 0, 0, width, height, dibDC, 0, 0, SRCCOPY);
+}
@@ -0,0 +1,34 @@
+#ifndef WIN32_PRESENTER_H_
+#define WIN32_PRESENTER_H_
+
+#include <windows.h>
+#include "presenter.h"
+
+// Presents 32 bit bgra DIB sections by blitting them to the window. The two DIBs are
+// offered as surfaces for the front and back buffers, present() then only selects the
+// one holding the frame. The DIBs only grow, resizing to a smaller window blits part of them.
+class Win32Presenter : public Presenter {
+private:
+    HDC hdc, dibDC;
+    HBITMAP dibs[2], dibBefore;
+    unsigned char *dibBits[2];
+    int selected; //dib selected into dibDC
+    int width, height; //size of the window
+    int dibWidth, dibHeight, stride; //size of the DIB sections
+
+    void initDIB();
+
+    void releaseDIB();
+public:
+    Win32Presenter(HDC windowDC);
+
+    ~Win32Presenter();
+
+    void resize(int width, int height) override;
+
+    int getSurfaces(Surface *surfaces) override;
+
+    void present(const FrameBuffer *fb) override;
+};
+
+#endif /* WIN32_PRESENTER_H_ */
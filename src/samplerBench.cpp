@@ -0,0 +1,126 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "graphicLib/sampler.h"
+
+// Lookups per second of Sampler::texture2D, bilinear for every texel layout and for
+// BC1 blocks, then point sampled. Each pattern walks size lines of size samples one
+// texel apart across the texture, turned by an angle: 0 runs along rows, 90 down
+// columns, 30 as on a rotated face.
+
+struct AccessPattern {
+    const char *name;
+    float degrees;
+};
+
+struct TexelStorage {
+    const char *name;
+    int layout;
+    int format;
+};
+
+void printUsage() {
+    std::cout << "usage: RendererSamplerBench [--size N] [--passes N]" << std::endl;
+}
+
+// position of sample i on line of the pattern, wrapped into 0..1
+inline void walk(float cosA, float sinA, float invSize, int line, int i, float &s, float &t) {
+    float u = i * invSize - 0.5f, v = line * invSize - 0.5f;
+    s = 0.5f + cosA * u - sinA * v;
+    t = 0.5f + sinA * u + cosA * v;
+    s -= floorf(s);
+    t -= floorf(t);
+}
+
+// million samples per second, sum keeps the lookups alive
+double scalarRate(Sampler &sampler, int size, float degrees, float &sum) {
+    const float angle = degrees * 3.14159265f / 180.0f;
+    const float cosA = cosf(angle), sinA = sinf(angle), invSize = 1.0f / size;
+    auto start = std::chrono::steady_clock::now();
+    for (int line = 0; line < size; line++) {
+        for (int i = 0; i < size; i++) {
+            float s, t;
+            walk(cosA, sinA, invSize, line, i, s, t);
+            sum += sampler.texture2D(s, t).x;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double) size * size / elapsed.count() * 1e-6;
+}
+
+// batches of count lookups through the batched texture2D, PACKET_SIZE is one packet
+template<int count>
+double batchRate(Sampler &sampler, int size, float degrees, float &sum) {
+    const float angle = degrees * 3.14159265f / 180.0f;
+    const float cosA = cosf(angle), sinA = sinf(angle), invSize = 1.0f / size;
+    auto start = std::chrono::steady_clock::now();
+    for (int line = 0; line < size; line++) {
+        for (int i = 0; i < size; i += count) {
+            float s[count], t[count];
+            for (int lane = 0; lane < count; lane++)
+                walk(cosA, sinA, invSize, line, i + lane, s[lane], t[lane]);
+            Sse::Vec4f red[count / PACKET_SIZE], green[count / PACKET_SIZE], blue[count / PACKET_SIZE];
+            sampler.texture2D(s, t, count, red, green, blue);
+            float lanes[PACKET_SIZE];
+            red[0].store(lanes);
+            sum += lanes[0];
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double) size * size / elapsed.count() * 1e-6;
+}
+
+int main(int argc, char **argv) {
+    int size = 2048, passes = 3;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--size")
+            size = atoi(argv[++i]);
+        else if (i + 1 < argc && arg == "--passes")
+            passes = atoi(argv[++i]);
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (size < PACKET_SIZE || passes <= 0) {
+        printUsage();
+        return 1;
+    }
+
+    const AccessPattern patterns[] = {{"horizontal", 0.0f}, {"vertical", 90.0f}, {"rotated", 30.0f}};
+    const TexelStorage storages[] = {{"linear", LAYOUT_LINEAR, TEXEL_RGBA8}, {"tiled4", LAYOUT_TILED4, TEXEL_RGBA8},
+                                     {"tiled8", LAYOUT_TILED8, TEXEL_RGBA8}, {"bc1", LAYOUT_LINEAR, TEXEL_BC1}};
+    std::cout << size << "x" << size << " texture, best of " << passes << " passes, million samples/s"
+              << std::endl;
+    std::cout << std::setw(8) << "texels" << std::setw(12) << "pattern" << std::setw(10) << "scalar"
+              << std::setw(10) << "batch4" << std::setw(10) << "batch8" << std::setw(10) << "point" << std::endl;
+    float sum = 0;
+    for (const TexelStorage &storage : storages) {
+        Sampler sampler(size, size);
+        unsigned int seed = 1;
+        for (int i = 0; i < size * size * 4; i++) {
+            seed = seed * 1664525u + 1013904223u;
+            sampler.imgData[i] = (unsigned char) (seed >> 24);
+        }
+        sampler.setTexelLayout(storage.layout);
+        sampler.compress(storage.format);
+        for (const AccessPattern &pattern : patterns) {
+            double scalar = 0, batch4 = 0, batch8 = 0, point = 0;
+            for (int pass = 0; pass < passes; pass++) {
+                scalar = max(scalar, scalarRate(sampler, size, pattern.degrees, sum));
+                batch4 = max(batch4, batchRate<PACKET_SIZE>(sampler, size, pattern.degrees, sum));
+                batch8 = max(batch8, batchRate<2 * PACKET_SIZE>(sampler, size, pattern.degrees, sum));
+                sampler.bindState(samplerPoint);
+                point = max(point, scalarRate(sampler, size, pattern.degrees, sum));
+                sampler.bindState(samplerBilinear);
+            }
+            std::cout << std::setw(8) << storage.name << std::setw(12) << pattern.name << std::fixed
+                      << std::setprecision(1) << std::setw(10) << scalar << std::setw(10) << batch4
+                      << std::setw(10) << batch8 << std::setw(10) << point << std::endl;
+        }
+    }
+    return sum == 12345.0f ? 2 : 0;
+}
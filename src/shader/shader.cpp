@@ -1,10 +1,27 @@
 #include "shader.h"
+#include "../util/util.h"
+#include "../graphicLib/rasterVariant.h"
 
-Mat44 modelMatrix, viewMatrix, projectMatrix,
+RENDER_LOCAL Mat44 modelMatrix, viewMatrix, projectMatrix,
         lightProjectionMatrix, lightViewMatrix;
-Vec4 lightDir, amb, diff, ambMat, diffMat;
-Sampler *currTexture = nullptr;
-Sampler *depthTexture = nullptr;
+RENDER_LOCAL Vec4 lightDir, amb, diff, ambMat, diffMat;
+RENDER_LOCAL Sampler *currTexture = nullptr;
+RENDER_LOCAL Sampler *depthTexture = nullptr;
+RENDER_LOCAL UniformBlock uniformBlock;
+
+void updateUniformBlock() {
+    Mat44 bias = translate(0.5, 0.5, 0.5) * scale(0.5);
+    uniformBlock.lightMatrix = bias * lightProjectionMatrix * lightViewMatrix;
+    uniformBlock.lightDirection = lightDir.Trim().GetNormalized();
+    uniformBlock.ambient = amb * ambMat;
+    uniformBlock.diffuse = diff * diffMat;
+}
+
+void bindTexture(Sampler *sampler, const SamplerState &state) {
+    currTexture = sampler;
+    if (sampler != nullptr)
+        sampler->bindState(state);
+}
 
 void vertexShader(const Vertex &input, VertexOut &output) noexcept {
     Vec4 modelNormal(input.Normal, 0.0);
@@ -12,6 +29,7 @@ void vertexShader(const Vertex &input, VertexOut &output) noexcept {
     output.World = modelMatrix * input.Model;
     output.View = viewMatrix * output.World;
     output.Clip = projectMatrix * output.View;
+    output.Light = uniformBlock.lightMatrix * output.World;
     output.Normal = worldNormal.Trim();
     output.s = input.s;
     output.t = input.t;
@@ -19,42 +37,97 @@ void vertexShader(const Vertex &input, VertexOut &output) noexcept {
 
 void fragmentShader(const Fragment &input, FragmentOut &output) noexcept {
     const auto worldNormal = input.Normal.GetNormalized();
-    const auto worldLightDir = lightDir.Trim().GetNormalized();
-    const auto nDotL = max(worldLightDir.DotProduct(worldNormal), 0.0);
+    const auto nDotL = max(uniformBlock.lightDirection.DotProduct(worldNormal), 0.0);
 
-    Vec4 lightColor = amb * ambMat + (diff * diffMat) * nDotL;
+    Vec4 lightColor = uniformBlock.ambient + uniformBlock.diffuse * nDotL;
     float shadowFactor = 1;
-    Vec4 shadowVert = lightProjectionMatrix * lightViewMatrix * input.World;
+    Vec4 shadowVert = input.Light;
     shadowVert *= (1.0f / shadowVert.w);
     float bias = 0.00001;
-    if (shadowVert.x <= 1 && shadowVert.x >= -1 &&
-        shadowVert.y <= 1 && shadowVert.y >= -1 &&
-        shadowVert.z <= 1 && shadowVert.z >= -1) {
-        shadowVert.x = 0.5f * (shadowVert.x + 1);
-        shadowVert.y = 0.5f * (shadowVert.y + 1);
-        shadowVert.z = 0.5f * (shadowVert.z + 1);
-        float depthStore = depthTexture->texture2D(shadowVert.x, shadowVert.y).x;
-        float depthNow = shadowVert.z + bias;
-        if (depthNow > depthStore)
-            shadowFactor = 0.5;
+    if (shadowVert.x <= 1 && shadowVert.x >= 0 &&
+        shadowVert.y <= 1 && shadowVert.y >= 0 &&
+        shadowVert.z <= 1 && shadowVert.z >= 0) {
+        float lit = depthTexture->textureCompare(shadowVert.x, shadowVert.y, shadowVert.z + bias);
+        shadowFactor = 0.5f + 0.5f * lit;
     }
 
     lightColor *= shadowFactor;
     Vec4 texColor(1, 1, 1, 1);
-    if (currTexture != nullptr) texColor = currTexture->texture2D(input.s, input.t) * 1.2;
+    if (currTexture != nullptr)
+        texColor = currTexture->texture2DGrad(input.s, input.t, input.dsdx, input.dtdx, input.dsdy, input.dtdy) * 1.2;
     output.Color = texColor * lightColor;
 }
 
 void simpleFragShader(const Fragment &input, FragmentOut &output) noexcept {
     const auto worldNormal = input.Normal.GetNormalized();
-    const auto worldLightDir = lightDir.Trim().GetNormalized();
-    const auto nDotL = max(worldLightDir.DotProduct(worldNormal), 0.0);
+    const auto nDotL = max(uniformBlock.lightDirection.DotProduct(worldNormal), 0.0);
 
-    const auto lightColor = amb * ambMat + (diff * diffMat) * nDotL;
+    const auto lightColor = uniformBlock.ambient + uniformBlock.diffuse * nDotL;
     const auto texColor = Vec4(1.2f, 1.2f, 0.0f, 0.0f);
     output.Color = lightColor * texColor + Vec4(0.0f, 0.0f, 0.0f, 0.6f);
 }
 
+// max(n . l, 0) for every lane with the normal normalized first
+inline Sse::Vec4f packetDiffuse(const FragmentPacket &input) noexcept {
+    using Sse::Vec4f;
+    const Vec3 &l = uniformBlock.lightDirection;
+    Vec4f lengthSqr = input.normalX * input.normalX + input.normalY * input.normalY + input.normalZ * input.normalZ;
+    Vec4f nDotL = (input.normalX * Vec4f(l.x) + input.normalY * Vec4f(l.y) + input.normalZ * Vec4f(l.z)) *
+                  lengthSqr.r_sqrt();
+    return Sse::select(nDotL > Vec4f(0.0f), nDotL, Vec4f(0.0f));
+}
+
+void fragmentPacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept {
+    using Sse::Vec4f;
+    const Vec4f nDotL = packetDiffuse(input);
+    const Vec4 &ambient = uniformBlock.ambient, &diffuse = uniformBlock.diffuse;
+
+    const Vec4f zero(0.0f), one(1.0f);
+    const Vec4f invW = one / input.lightW;
+    const Vec4f shadowX = input.lightX * invW, shadowY = input.lightY * invW, shadowZ = input.lightZ * invW;
+    const Vec4f inside = (shadowX <= one) & (shadowX >= zero) & (shadowY <= one) & (shadowY >= zero) &
+                         (shadowZ <= one) & (shadowZ >= zero);
+    Vec4f shadowFactor = one;
+    int shadowMask = inside.sign_bits() & input.mask;
+    if (shadowMask != 0) {
+        const float bias = 0.00001;
+        Vec4f lit = depthTexture->textureCompare(shadowX, shadowY, shadowZ + Vec4f(bias), shadowMask);
+        shadowFactor = Sse::select(inside, Vec4f(0.5f) + Vec4f(0.5f) * lit, one);
+    }
+
+    Vec4f texR = one, texG = one, texB = one, texA = one;
+    if (currTexture != nullptr) {
+        currTexture->texture2DGrad(input.s, input.t, dFdx(input.s), dFdx(input.t), dFdy(input.s), dFdy(input.t),
+                                   input.mask, texR, texG, texB);
+        texR = texR * Vec4f(1.2f);
+        texG = texG * Vec4f(1.2f);
+        texB = texB * Vec4f(1.2f);
+        texA = Vec4f(1.2f);
+    }
+    output.red = texR * ((Vec4f(ambient.x) + Vec4f(diffuse.x) * nDotL) * shadowFactor);
+    output.green = texG * ((Vec4f(ambient.y) + Vec4f(diffuse.y) * nDotL) * shadowFactor);
+    output.blue = texB * ((Vec4f(ambient.z) + Vec4f(diffuse.z) * nDotL) * shadowFactor);
+    output.alpha = texA * ((Vec4f(ambient.w) + Vec4f(diffuse.w) * nDotL) * shadowFactor);
+}
+
+void flatFragmentShader(const Fragment &input, FragmentOut &output) noexcept {
+    fragmentShader(input, output);
+}
+
+void flatPacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept {
+    fragmentPacketShader(input, output);
+}
+
+void simplePacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept {
+    using Sse::Vec4f;
+    const Vec4f nDotL = packetDiffuse(input);
+    const Vec4 &ambient = uniformBlock.ambient, &diffuse = uniformBlock.diffuse;
+    output.red = (Vec4f(ambient.x) + Vec4f(diffuse.x) * nDotL) * Vec4f(1.2f);
+    output.green = (Vec4f(ambient.y) + Vec4f(diffuse.y) * nDotL) * Vec4f(1.2f);
+    output.blue = Vec4f(0.0f);
+    output.alpha = Vec4f(0.6f);
+}
+
 void storeVertShader(const Vertex &input, VertexOut &output) noexcept {
     Vec4 modelNormal(input.Normal, 0.0);
     Vec4 worldNormal = modelMatrix * modelNormal;
@@ -64,6 +137,35 @@ void storeVertShader(const Vertex &input, VertexOut &output) noexcept {
     output.Normal = worldNormal.Trim();
 }
 
-void storeFragShader(const Fragment &input, FragmentOut &output) noexcept {
-    output.Color = Vec4(Sse::Vec4f(input.Ndc.GetZ() * 0.5f + 0.5f));
+void positionVertShader(const Vertex &input, VertexOut &output) noexcept {
+    Vec4 modelNormal(input.Normal, 0.0);
+    Vec4 worldNormal = modelMatrix * modelNormal;
+    output.World = modelMatrix * input.Model;
+    output.View = viewMatrix * output.World;
+    output.Clip = projectMatrix * output.View;
+    output.Normal = worldNormal.Trim();
+}
+
+inline Vec4 encodeNormal(const Vec3 &normal) {
+    return Vec4(normal.GetNormalized() * 0.5f + Vec3(0.5f, 0.5f, 0.5f), 1.0f);
+}
+
+void gbufferFragShader(const Fragment &input, FragmentOut &output) noexcept {
+    output.Color = Vec4(1, 1, 1, 1);
+    if (currTexture != nullptr)
+        output.Color = currTexture->texture2DGrad(input.s, input.t, input.dsdx, input.dtdx, input.dsdy, input.dtdy) * 1.2;
+    output.Color1 = encodeNormal(input.Normal);
+}
+
+void simpleGBufferFragShader(const Fragment &input, FragmentOut &output) noexcept {
+    output.Color = Vec4(1.2f, 1.2f, 0.0f, 1.0f);
+    output.Color1 = encodeNormal(input.Normal);
+}
+
+void initShaderVariants() {
+    registerShaderVariants<fragmentShader, fragmentPacketShader, LIT_VARYINGS>();
+    registerShaderVariants<flatFragmentShader, flatPacketShader, LIT_VARYINGS, FLAT_VARYINGS>();
+    registerShaderVariants<simpleFragShader, simplePacketShader, SIMPLE_VARYINGS>();
+    registerShaderVariants<gbufferFragShader, VARYING_TEXCOORD | VARYING_NORMAL, 0, true>();
+    registerShaderVariants<simpleGBufferFragShader, VARYING_NORMAL, 0, true>();
 }
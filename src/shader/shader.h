@@ -4,11 +4,26 @@
 #include "../graphicLib/sampler.h"
 
 //uniforms
-extern Mat44 modelMatrix, viewMatrix, projectMatrix,
+extern RENDER_LOCAL Mat44 modelMatrix, viewMatrix, projectMatrix,
         lightProjectionMatrix, lightViewMatrix;
-extern Vec4 lightDir, amb, diff, ambMat, diffMat;
-extern Sampler *currTexture;
-extern Sampler *depthTexture;
+extern RENDER_LOCAL Vec4 lightDir, amb, diff, ambMat, diffMat;
+extern RENDER_LOCAL Sampler *currTexture;
+extern RENDER_LOCAL Sampler *depthTexture;
+
+//values derived from the uniforms above, constant during a draw
+struct UniformBlock {
+    Mat44 lightMatrix; //world to shadow map coordinates in 0..1
+    Vec3 lightDirection; //normalized lightDir
+    Vec4 ambient; //amb * ambMat
+    Vec4 diffuse; //diff * diffMat
+};
+
+extern RENDER_LOCAL UniformBlock uniformBlock;
+
+void updateUniformBlock();
+
+// makes sampler the currTexture of the next draws, sampled as state says
+void bindTexture(Sampler *sampler, const SamplerState &state);
 
 void vertexShader(const Vertex &input, VertexOut &output) noexcept;
 
@@ -18,5 +33,30 @@ void simpleFragShader(const Fragment &input, FragmentOut &output) noexcept;
 
 void storeVertShader(const Vertex &input, VertexOut &output) noexcept;
 
-void storeFragShader(const Fragment &input, FragmentOut &output) noexcept;
+// vertexShader without the varyings, for the depth prepass. Clip matches vertexShader
+// bit for bit, World and Normal stay for culling.
+void positionVertShader(const Vertex &input, VertexOut &output) noexcept;
+
+// G-buffer outputs of the deferred path: albedo of fragmentShader and simpleFragShader
+// before lighting in Color, the world normal mapped to 0..1 in Color1
+void gbufferFragShader(const Fragment &input, FragmentOut &output) noexcept;
+
+void simpleGBufferFragShader(const Fragment &input, FragmentOut &output) noexcept;
+
+// varyings read by the fragment shaders, the specialized raster loops interpolate only these
+#define LIT_VARYINGS (VARYING_LIGHT | VARYING_NORMAL | VARYING_TEXCOORD)
+#define SIMPLE_VARYINGS VARYING_NORMAL
+#define FLAT_VARYINGS VARYING_NORMAL //of flatFragmentShader, taken from the provoking vertex
+
+// packet versions of fragmentShader and simpleFragShader
+void fragmentPacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept;
+
+void simplePacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept;
+
+// fragmentShader for meshes of planar faces, the specialized loops do not interpolate the normal
+void flatFragmentShader(const Fragment &input, FragmentOut &output) noexcept;
+
+void flatPacketShader(const FragmentPacket &input, FragmentPacketOut &output) noexcept;
 
+// specialized raster loops for the fragment shaders above, needs initRasterVariants first
+void initShaderVariants();
@@ -1,27 +1,131 @@
+#include <vector>
 #include "shadow.h"
 #include "../shader/shader.h"
 #include "../util/util.h"
 
-FrameBuffer *shadowFrame;
-DepthBuffer *shadowDepth;
-float shadowSize = 10;
+struct ShadowCaster {
+    Mat44 model;
+    const Vertex *verts;
+    int faceNum;
+    unsigned int meshRevision;
+    Rect bounds;
+    bool submitted;
+    bool dirty;
+};
+
+RENDER_LOCAL DepthBuffer *shadowDepth;
+RENDER_LOCAL float shadowSize = 10;
+RENDER_LOCAL unsigned int shadowLightRevision = 0;
+
+RENDER_LOCAL std::vector<ShadowCaster> shadowCasters;
+RENDER_LOCAL int shadowCasterNum = 0;
+RENDER_LOCAL int shadowCasterCount = 0;
+RENDER_LOCAL unsigned int cachedLightRevision = 0;
+RENDER_LOCAL bool shadowCached = false;
+RENDER_LOCAL Vec4 cachedLightDir;
+RENDER_LOCAL Mat44 cachedLightView, cachedLightProjection;
 
 void initShadow(int width, int height) {
-    initDevice(&shadowFrame, &shadowDepth, width, height);
-    depthTexture = new Sampler(width, height);
+    initDepthBuffer(&shadowDepth, width, height, LAYOUT_LINEAR, DEPTH_FLOAT32);
+    depthTexture = new Sampler(shadowDepth);
 
     lightProjectionMatrix = ortho(-shadowSize, shadowSize, -shadowSize, shadowSize, -shadowSize, shadowSize);
     lightViewMatrix = lookAt(lightDir.x, lightDir.y, lightDir.z,
                              0, 0, 0,
                              0.0f, 1.0f, 0.0f);
+    shadowCasterNum = 0;
+    shadowCached = false;
 }
 
 void releaseShadow() {
+    shadowCasters.clear();
+    shadowCasterNum = 0;
     delete depthTexture;
-    releaseDevice(&shadowFrame, &shadowDepth);
+    releaseDepthBuffer(&shadowDepth);
+}
+
+void invalidateShadowMap() {
+    shadowCached = false;
+}
+
+void updateShadowLightRevision() {
+    if (lightDir != cachedLightDir || lightViewMatrix != cachedLightView ||
+        lightProjectionMatrix != cachedLightProjection) {
+        cachedLightDir = lightDir;
+        cachedLightView = lightViewMatrix;
+        cachedLightProjection = lightProjectionMatrix;
+        shadowLightRevision++;
+    }
+}
+
+Rect calcCasterBounds(const ShadowCaster &caster) {
+    Mat44 lightMvp = lightProjectionMatrix * lightViewMatrix * caster.model;
+    float minX = shadowDepth->width, minY = shadowDepth->height, maxX = -1, maxY = -1;
+    for (int i = 0; i < caster.faceNum * 3; i++) {
+        Vec4 clip = lightMvp * caster.verts[i].Model;
+        float scrX, scrY;
+        viewPortTransform(clip.x / clip.w, clip.y / clip.w, shadowDepth->width, shadowDepth->height, scrX, scrY);
+        minX = min(minX, scrX);
+        minY = min(minY, scrY);
+        maxX = max(maxX, scrX);
+        maxY = max(maxY, scrY);
+    }
+    // one pixel margin covers the rounding of span ends in rasterize2
+    Rect bounds((int) floorf(minX) - 1, (int) floorf(minY) - 1, (int) ceilf(maxX) + 1, (int) ceilf(maxY) + 1);
+    return intersectRect(bounds, Rect(0, 0, shadowDepth->width - 1, shadowDepth->height - 1));
+}
+
+void castShadow(const Mat44 &model, const Vertex *verts, int faceNum, unsigned int meshRevision) {
+    if (shadowCasterCount == (int) shadowCasters.size()) {
+        ShadowCaster caster = {};
+        shadowCasters.push_back(caster);
+    }
+    ShadowCaster &caster = shadowCasters[shadowCasterCount++];
+    caster.dirty = !caster.submitted || caster.model != model || caster.verts != verts ||
+                   caster.faceNum != faceNum || caster.meshRevision != meshRevision;
+    caster.submitted = true;
+    if (!caster.dirty)
+        return;
+    caster.model = model;
+    caster.verts = verts;
+    caster.faceNum = faceNum;
+    caster.meshRevision = meshRevision;
+}
+
+Rect collectDirtyRegion(bool fullUpdate) {
+    Rect full(0, 0, shadowDepth->width - 1, shadowDepth->height - 1);
+    Rect dirty;
+    for (int i = 0; i < max(shadowCasterCount, shadowCasterNum); i++) {
+        ShadowCaster &caster = shadowCasters[i];
+        if (i >= shadowCasterCount) {
+            // caster disappeared since last frame
+            dirty = unionRect(dirty, caster.bounds);
+            caster.submitted = false;
+            caster.bounds = Rect();
+            continue;
+        }
+        if (!caster.dirty && !fullUpdate)
+            continue;
+        Rect bounds = calcCasterBounds(caster);
+        dirty = unionRect(dirty, unionRect(caster.bounds, bounds));
+        caster.bounds = bounds;
+    }
+    shadowCasterNum = shadowCasterCount;
+    return fullUpdate ? full : dirty;
 }
 
 void renderShadowMap(DrawCall renderCall) {
+    updateShadowLightRevision();
+    bool fullUpdate = !shadowCached || cachedLightRevision != shadowLightRevision;
+
+    shadowCasterCount = 0;
+    renderCall();
+    Rect dirty = collectDirtyRegion(fullUpdate);
+    cachedLightRevision = shadowLightRevision;
+    shadowCached = true;
+    if (dirty.empty())
+        return;
+
     float tmpX = eyeX;
     float tmpY = eyeY;
     float tmpZ = eyeZ;
@@ -31,14 +135,21 @@ void renderShadowMap(DrawCall renderCall) {
     eyeZ = lightDir.z * 2;
     clipNear = -shadowSize;
 
-    clearScreenFast(shadowFrame, 255);
-    clearDepth(shadowDepth);
-    renderCall();
-    writeFrameBuffer2Sampler(shadowFrame, depthTexture);
+    clearDepthRect(shadowDepth, dirty);
+    scissorFlag = true;
+    scissorRect = dirty;
+    for (int i = 0; i < shadowCasterNum; i++) {
+        const ShadowCaster &caster = shadowCasters[i];
+        if (intersectRect(caster.bounds, dirty).empty())
+            continue;
+        modelMatrix = caster.model;
+        drawFaces(nullptr, shadowDepth, storeVertShader, nullptr, CULL_FRONT,
+                  caster.verts, caster.faceNum);
+    }
+    scissorFlag = false;
 
     eyeX = tmpX;
     eyeY = tmpY;
     eyeZ = tmpZ;
     clipNear = tmpNear;
 }
-
@@ -4,13 +4,19 @@
 #include "../graphicLib/sampler.h"
 #include "../graphicLib/graphicLib.h"
 
-extern FrameBuffer *shadowFrame;
-extern DepthBuffer *shadowDepth;
+extern RENDER_LOCAL DepthBuffer *shadowDepth;
+extern RENDER_LOCAL unsigned int shadowLightRevision;
 
 void initShadow(int width, int height);
 
 void releaseShadow();
 
+void invalidateShadowMap();
+
+// Called from the shadow DrawCall once per caster and frame. A caster is redrawn when its
+// model matrix, vertex array, face count or meshRevision differ from the last frame.
+void castShadow(const Mat44 &model, const Vertex *verts, int faceNum, unsigned int meshRevision);
+
 void renderShadowMap(DrawCall renderCall);
 
 #endif /* SHADOW_H_ */
@@ -2,6 +2,7 @@
 
 Sphere::Sphere(int m, int n) {
     faceNum = (m - 1) * n * 2;
+    revision = 0;
     verts = new Vertex[faceNum * 3];
 
     float stepAngZ = PI / m;
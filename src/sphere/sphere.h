@@ -8,11 +8,14 @@ private:
     int faceNum;
 public:
     Vertex *verts;
+    unsigned int revision; //bumped by whoever changes verts in place
 
     Sphere(int m, int n);
 
     ~Sphere();
 
+    int getFaceNum() const { return faceNum; }
+
     void render(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader fs, int cullFlag);
 };
 
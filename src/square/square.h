@@ -16,6 +16,8 @@ public:
 
     ~Square();
 
+    int getFaceNum() const { return faceNum; }
+
     void render(FrameBuffer *fb, DepthBuffer *db, VertexShader vs, FragmentShader fs, int cullFlag);
 };
 
@@ -1,4 +1,5 @@
 #include "BmpLoader.h"
+#include <string.h>
 
 BmpLoader::BmpLoader() {
     header = new unsigned char[54];
@@ -52,4 +53,41 @@ int BmpLoader::getHeight() {
     return height;
 }
 
+bool saveBitmap(const char *fileName, const unsigned char *bgr, int width, int height, int channels) {
+    FILE *file = fopen(fileName, "wb");
+    if (!file) {
+        printf("Image %s could not be written\n", fileName);
+        return false;
+    }
+    int stride = (width * 3 + 3) & ~3;
+    unsigned int imageSize = stride * height;
+    unsigned int fileSize = 54 + imageSize;
+    unsigned char header[54];
+    memset(header, 0, sizeof(header));
+    header[0] = 'B';
+    header[1] = 'M';
+    *(unsigned int *) &(header[0x02]) = fileSize;
+    *(unsigned int *) &(header[0x0A]) = 54;
+    *(unsigned int *) &(header[0x0E]) = 40;
+    *(int *) &(header[0x12]) = width;
+    *(int *) &(header[0x16]) = height;
+    *(unsigned short *) &(header[0x1A]) = 1;
+    *(unsigned short *) &(header[0x1C]) = 24;
+    *(unsigned int *) &(header[0x22]) = imageSize;
+    fwrite(header, 1, 54, file);
 
+    unsigned char *row = new unsigned char[stride];
+    memset(row, 0, stride);
+    for (int i = height - 1; i >= 0; i--) {// bmp rows are stored bottom-up
+        const unsigned char *src = bgr + i * width * channels;
+        for (int j = 0; j < width; j++) {
+            row[j * 3] = src[j * channels];
+            row[j * 3 + 1] = src[j * channels + 1];
+            row[j * 3 + 2] = src[j * channels + 2];
+        }
+        fwrite(row, 1, stride, file);
+    }
+    delete[] row;
+    fclose(file);
+    return true;
+}
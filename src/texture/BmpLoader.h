@@ -33,4 +33,7 @@ public:
     bool loadBitmap(const char *fileName);
 };
 
+// bgr or bgra (channels 3/4) pixels, rows top to bottom without padding
+bool saveBitmap(const char *fileName, const unsigned char *bgr, int width, int height, int channels = 3);
+
 #endif
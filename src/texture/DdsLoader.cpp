@@ -0,0 +1,107 @@
+#include "DdsLoader.h"
+
+#define DDS_HEADER_SIZE 124
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+
+inline unsigned int fourCC(const char *code) {
+    return code[0] | (code[1] << 8) | (code[2] << 16) | ((unsigned int) code[3] << 24);
+}
+
+DdsLoader::DdsLoader() {
+    width = height = 0;
+    format = TEXEL_RGBA8;
+    mipLevels = 0;
+    data = nullptr;
+}
+
+DdsLoader::~DdsLoader() {
+    delete[] data;
+}
+
+bool DdsLoader::loadDds(const char *fileName) {
+    FILE *file = fopen(fileName, "rb");
+    if (!file)
+        return false;
+    unsigned int header[1 + DDS_HEADER_SIZE / 4];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || header[0] != fourCC("DDS ") ||
+        header[1] != DDS_HEADER_SIZE) {
+        printf("Not a correct DDS file\n");
+        fclose(file);
+        return false;
+    }
+    // everything read below is sized from the header, so it is checked before allocating
+    const unsigned int maxSize = 1u << (MAX_MIP_LEVELS - 1);
+    if (header[3] == 0 || header[4] == 0 || header[3] > maxSize || header[4] > maxSize) {
+        printf("DDS file %s has a bad size\n", fileName);
+        fclose(file);
+        return false;
+    }
+    height = (int) header[3];
+    width = (int) header[4];
+    int fullChain = 1;
+    while ((max(width, height) >> fullChain) > 0)
+        fullChain++;
+    mipLevels = (header[2] & DDSD_MIPMAPCOUNT) && header[7] > 0 ? (int) min(header[7], 1u + MAX_MIP_LEVELS) : 1;
+    if (mipLevels > fullChain) {
+        printf("DDS file %s has more mip levels than its size allows\n", fileName);
+        fclose(file);
+        return false;
+    }
+    // the pixel format starts at byte 72 of the header, its flags at 76 and its four cc at 80
+    const unsigned int code = header[1 + 76 / 4] & DDPF_FOURCC ? header[1 + 80 / 4] : 0;
+    if (code == fourCC("DXT1"))
+        format = TEXEL_BC1;
+    else if (code == fourCC("ATI1") || code == fourCC("BC4U"))
+        format = TEXEL_BC4;
+    else if (code == fourCC("ATI2") || code == fourCC("BC5U"))
+        format = TEXEL_BC5;
+    else {
+        printf("Unsupported DDS format in %s\n", fileName);
+        fclose(file);
+        return false;
+    }
+    int size = 0;
+    for (int i = 0, w = width, h = height; i < mipLevels; i++, w = max(1, w / 2), h = max(1, h / 2))
+        size += compressedSize(format, w, h);
+    data = new unsigned char[size];
+    bool complete = fread(data, 1, size, file) == (size_t) size;
+    fclose(file);
+    if (!complete)
+        printf("DDS file %s is truncated\n", fileName);
+    return complete;
+}
+
+bool saveDds(const char *fileName, int format, int width, int height, int levels,
+             const unsigned char *blocks, int size) {
+    FILE *file = fopen(fileName, "wb");
+    if (!file) {
+        printf("Image %s could not be written\n", fileName);
+        return false;
+    }
+    unsigned int header[1 + DDS_HEADER_SIZE / 4];
+    memset(header, 0, sizeof(header));
+    header[0] = fourCC("DDS ");
+    header[1] = DDS_HEADER_SIZE;
+    header[2] = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+    header[3] = height;
+    header[4] = width;
+    header[5] = compressedSize(format, width, height);
+    header[7] = levels;
+    header[1 + 72 / 4] = 32;
+    header[1 + 76 / 4] = DDPF_FOURCC;
+    header[1 + 80 / 4] = fourCC(format == TEXEL_BC1 ? "DXT1" : format == TEXEL_BC4 ? "ATI1" : "ATI2");
+    header[1 + 104 / 4] = DDSCAPS_TEXTURE | (levels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+    bool written = fwrite(header, 1, sizeof(header), file) == sizeof(header) &&
+                   fwrite(blocks, 1, size, file) == (size_t) size;
+    fclose(file);
+    return written;
+}
@@ -0,0 +1,27 @@
+#ifndef DDSLOADER_H_
+#define DDSLOADER_H_
+
+#include "../header/header.h"
+#include "blockCompression.h"
+
+// DDS files with a BC1 (DXT1), BC4 (ATI1/BC4U) or BC5 (ATI2/BC5U) mip chain, as written
+// by RendererTextureCompress. Levels are stored largest first, each halved down to 1x1.
+class DdsLoader {
+public:
+    int width, height;
+    int format; //TEXEL_BC1, TEXEL_BC4 or TEXEL_BC5
+    int mipLevels;
+    unsigned char *data; //blocks of all levels back to back
+
+    DdsLoader();
+
+    ~DdsLoader();
+
+    bool loadDds(const char *fileName);
+};
+
+// size bytes of blocks holding levels mip levels of a width x height texture
+bool saveDds(const char *fileName, int format, int width, int height, int levels,
+             const unsigned char *blocks, int size);
+
+#endif /* DDSLOADER_H_ */
@@ -0,0 +1,224 @@
+#include <math.h>
+#include "blockCompression.h"
+
+int blockBytes(int format) {
+    return format == TEXEL_BC5 ? 16 : 8;
+}
+
+int compressedSize(int format, int width, int height) {
+    return blockBytes(format) * ((width + 3) / 4) * ((height + 3) / 4);
+}
+
+inline int expand565(int c, int shift, int bits) {
+    int v = (c >> shift) & ((1 << bits) - 1);
+    return (v << (8 - bits)) | (v >> (2 * bits - 8));
+}
+
+// the four colors a BC1 block chooses from, the fourth is transparent black when c0 <= c1
+void bc1Palette(int c0, int c1, int palette[4][4]) {
+    const int ends[2] = {c0, c1};
+    for (int i = 0; i < 2; i++) {
+        palette[i][0] = expand565(ends[i], 11, 5);
+        palette[i][1] = expand565(ends[i], 5, 6);
+        palette[i][2] = expand565(ends[i], 0, 5);
+        palette[i][3] = 255;
+    }
+    for (int ch = 0; ch < 3; ch++) {
+        if (c0 > c1) {
+            palette[2][ch] = (2 * palette[0][ch] + palette[1][ch]) / 3;
+            palette[3][ch] = (palette[0][ch] + 2 * palette[1][ch]) / 3;
+        } else {
+            palette[2][ch] = (palette[0][ch] + palette[1][ch]) / 2;
+            palette[3][ch] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = c0 > c1 ? 255 : 0;
+}
+
+// the eight values a BC4 block chooses from
+void bc4Palette(int a0, int a1, int palette[8]) {
+    palette[0] = a0;
+    palette[1] = a1;
+    if (a0 > a1) {
+        for (int i = 1; i < 7; i++)
+            palette[i + 1] = ((7 - i) * a0 + i * a1) / 7;
+    } else {
+        for (int i = 1; i < 5; i++)
+            palette[i + 1] = ((5 - i) * a0 + i * a1) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+inline int pack565(const float *rgb) {
+    int r = (int) (max(0.0f, min(rgb[0], 255.0f)) * (31.0f / 255.0f) + 0.5f);
+    int g = (int) (max(0.0f, min(rgb[1], 255.0f)) * (63.0f / 255.0f) + 0.5f);
+    int b = (int) (max(0.0f, min(rgb[2], 255.0f)) * (31.0f / 255.0f) + 0.5f);
+    return (r << 11) | (g << 5) | b;
+}
+
+// Endpoints at the texels furthest apart along the principal axis of the block colors,
+// every texel takes the nearest of the four palette colors.
+void encodeBC1(const unsigned char texels[16][4], unsigned char *block) {
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        for (int ch = 0; ch < 3; ch++)
+            mean[ch] += texels[i][ch] * (1.0f / 16);
+    }
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++) {
+        float r = texels[i][0] - mean[0], g = texels[i][1] - mean[1], b = texels[i][2] - mean[2];
+        cov[0] += r * r;
+        cov[1] += r * g;
+        cov[2] += r * b;
+        cov[3] += g * g;
+        cov[4] += g * b;
+        cov[5] += b * b;
+    }
+    float axis[3] = {1, 1, 1};
+    for (int iter = 0; iter < 8; iter++) {
+        float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+        float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+        float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+        float len = max(fabsf(x), max(fabsf(y), fabsf(z)));
+        if (len < 1e-6f) break;
+        axis[0] = x / len;
+        axis[1] = y / len;
+        axis[2] = z / len;
+    }
+    int lo = 0, hi = 0;
+    float minDot = 0, maxDot = 0;
+    for (int i = 0; i < 16; i++) {
+        float d = texels[i][0] * axis[0] + texels[i][1] * axis[1] + texels[i][2] * axis[2];
+        if (i == 0 || d < minDot) {
+            minDot = d;
+            lo = i;
+        }
+        if (i == 0 || d > maxDot) {
+            maxDot = d;
+            hi = i;
+        }
+    }
+    const float hiColor[3] = {(float) texels[hi][0], (float) texels[hi][1], (float) texels[hi][2]};
+    const float loColor[3] = {(float) texels[lo][0], (float) texels[lo][1], (float) texels[lo][2]};
+    int c0 = pack565(hiColor), c1 = pack565(loColor);
+    if (c0 < c1) {
+        int c = c0;
+        c0 = c1;
+        c1 = c;
+    }
+    unsigned int indices = 0;
+    if (c0 != c1) {
+        int palette[4][4];
+        bc1Palette(c0, c1, palette);
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = 0;
+            for (int p = 0; p < 4; p++) {
+                int dr = texels[i][0] - palette[p][0], dg = texels[i][1] - palette[p][1];
+                int db = texels[i][2] - palette[p][2];
+                int dist = dr * dr + dg * dg + db * db;
+                if (p == 0 || dist < bestDist) {
+                    best = p;
+                    bestDist = dist;
+                }
+            }
+            indices |= (unsigned int) best << (2 * i);
+        }
+    }
+    block[0] = (unsigned char) c0;
+    block[1] = (unsigned char) (c0 >> 8);
+    block[2] = (unsigned char) c1;
+    block[3] = (unsigned char) (c1 >> 8);
+    memcpy(block + 4, &indices, 4);
+}
+
+// the range of the values as the two end points with six steps between them
+void encodeBC4(const unsigned char texels[16][4], int channel, unsigned char *block) {
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = max(a0, (int) texels[i][channel]);
+        a1 = min(a1, (int) texels[i][channel]);
+    }
+    unsigned long long indices = 0;
+    if (a0 != a1) {
+        int palette[8];
+        bc4Palette(a0, a1, palette);
+        for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = 256;
+            for (int p = 0; p < 8; p++) {
+                int dist = abs(texels[i][channel] - palette[p]);
+                if (dist < bestDist) {
+                    best = p;
+                    bestDist = dist;
+                }
+            }
+            indices |= (unsigned long long) best << (3 * i);
+        }
+    }
+    block[0] = (unsigned char) a0;
+    block[1] = (unsigned char) a1;
+    for (int i = 0; i < 6; i++)
+        block[2 + i] = (unsigned char) (indices >> (8 * i));
+}
+
+void compressTexels(int format, const unsigned char *rgba, int width, int height, unsigned char *blocks) {
+    const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    unsigned char texels[16][4];
+    for (int by = 0; by < blocksY; by++) {
+        for (int bx = 0; bx < blocksX; bx++) {
+            for (int i = 0; i < 16; i++) {
+                int x = min(bx * 4 + (i & 3), width - 1), y = min(by * 4 + (i >> 2), height - 1);
+                memcpy(texels[i], rgba + 4 * (y * width + x), 4);
+            }
+            if (format == TEXEL_BC1) {
+                encodeBC1(texels, blocks);
+            } else if (format == TEXEL_BC4) {
+                encodeBC4(texels, 0, blocks);
+            } else {
+                encodeBC4(texels, 0, blocks);
+                encodeBC4(texels, 1, blocks + 8);
+            }
+            blocks += blockBytes(format);
+        }
+    }
+}
+
+void decodeBC4(const unsigned char *block, unsigned char *rgba, int channel) {
+    int palette[8];
+    bc4Palette(block[0], block[1], palette);
+    unsigned long long indices = 0;
+    for (int i = 0; i < 6; i++)
+        indices |= (unsigned long long) block[2 + i] << (8 * i);
+    for (int i = 0; i < 16; i++)
+        rgba[4 * i + channel] = (unsigned char) palette[(indices >> (3 * i)) & 7];
+}
+
+void decodeBlock(int format, const unsigned char *block, unsigned char *rgba) {
+    if (format == TEXEL_BC1) {
+        int palette[4][4];
+        bc1Palette(block[0] | (block[1] << 8), block[2] | (block[3] << 8), palette);
+        unsigned int colors[4], indices;
+        for (int p = 0; p < 4; p++) {
+            const unsigned char color[4] = {(unsigned char) palette[p][0], (unsigned char) palette[p][1],
+                                            (unsigned char) palette[p][2], (unsigned char) palette[p][3]};
+            memcpy(&colors[p], color, 4);
+        }
+        memcpy(&indices, block + 4, 4);
+        for (int i = 0; i < 16; i++)
+            memcpy(rgba + 4 * i, &colors[(indices >> (2 * i)) & 3], 4);
+    } else if (format == TEXEL_BC4) {
+        decodeBC4(block, rgba, 0);
+        for (int i = 0; i < 16; i++) {
+            rgba[4 * i + 1] = rgba[4 * i + 2] = rgba[4 * i];
+            rgba[4 * i + 3] = 255;
+        }
+    } else {
+        decodeBC4(block, rgba, 0);
+        decodeBC4(block + 8, rgba, 1);
+        for (int i = 0; i < 16; i++) {
+            rgba[4 * i + 2] = 0;
+            rgba[4 * i + 3] = 255;
+        }
+    }
+}
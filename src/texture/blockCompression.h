@@ -0,0 +1,22 @@
+#ifndef BLOCKCOMPRESSION_H_
+#define BLOCKCOMPRESSION_H_
+
+#include "../header/header.h"
+
+// BC1, BC4 and BC5 blocks as in D3D, each holding 4x4 texels. Blocks are stored row
+// by row, levels that are not a multiple of 4 are padded with their edge texels.
+
+// bytes of one block of a TEXEL_BC* format
+int blockBytes(int format);
+
+// bytes of a width x height level
+int compressedSize(int format, int width, int height);
+
+// encodes rgba texels, BC4 keeps red and BC5 red and green
+void compressTexels(int format, const unsigned char *rgba, int width, int height, unsigned char *blocks);
+
+// the 16 texels of one block as rgba, row by row. BC4 decodes to gray,
+// BC5 to red and green with blue 0, both opaque.
+void decodeBlock(int format, const unsigned char *block, unsigned char *rgba);
+
+#endif /* BLOCKCOMPRESSION_H_ */
@@ -1,14 +1,33 @@
 #include "texture.h"
+#include "DdsLoader.h"
 #include "../header/header.h"
 
-Texture::Texture(const char *src) {
+Texture::Texture(const char *src, int format) {
+    const char *extension = strrchr(src, '.');
+    if (extension != nullptr && strcmp(extension, ".dds") == 0) {
+        DdsLoader *dds = new DdsLoader();
+        if (dds->loadDds(src)) {
+            sampler = new Sampler(dds->width, dds->height, dds->format, dds->mipLevels, dds->data);
+            sampler->bindState(samplerTrilinear);
+        } else {
+            sampler = NULL;
+        }
+        delete dds;
+        return;
+    }
     BmpLoader *loader = new BmpLoader();
     if (!loader->loadBitmap(src)) {
         sampler = NULL;
         return;
     }
     sampler = new Sampler(loader->width, loader->height);
-    memcpy(sampler->imgData, loader->data, loader->width * loader->height * 3 * sizeof(unsigned char));
+    for (unsigned int i = 0; i < loader->width * loader->height; i++) {
+        memcpy(sampler->imgData + 4 * i, loader->data + 3 * i, 3);
+        sampler->imgData[4 * i + 3] = 255;
+    }
+    sampler->generateMipmaps();
+    sampler->compress(format);
+    sampler->bindState(samplerTrilinear);
     delete loader;
 }
 
@@ -8,7 +8,9 @@ class Texture {
 public:
     Sampler *sampler;
 
-    Texture(const char *src);
+    // a bmp, encoded into TEXEL_BC* blocks at load unless format is TEXEL_RGBA8,
+    // or a dds of RendererTextureCompress, whose blocks are kept as they are
+    Texture(const char *src, int format = TEXEL_RGBA8);
 
     ~Texture();
 };
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include "texture/texture.h"
+#include "texture/DdsLoader.h"
+
+// Offline step of the asset import: encodes a bmp and its mip chain into BC blocks
+// and writes them as a DDS file, which the renderer loads without encoding again.
+void printUsage() {
+    std::cout << "usage: RendererTextureCompress [--format bc1|bc4|bc5] input.bmp output.dds" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int format = TEXEL_BC1;
+    const char *input = nullptr, *output = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 < argc && arg == "--format") {
+            std::string name = argv[++i];
+            if (name == "bc1")
+                format = TEXEL_BC1;
+            else if (name == "bc4")
+                format = TEXEL_BC4;
+            else if (name == "bc5")
+                format = TEXEL_BC5;
+            else {
+                printUsage();
+                return 1;
+            }
+        } else if (input == nullptr)
+            input = argv[i];
+        else if (output == nullptr)
+            output = argv[i];
+        else {
+            printUsage();
+            return 1;
+        }
+    }
+    if (input == nullptr || output == nullptr) {
+        printUsage();
+        return 1;
+    }
+
+    Texture texture(input, format);
+    if (texture.sampler == nullptr)
+        return 1;
+    const Sampler *sampler = texture.sampler;
+    std::vector<unsigned char> blocks;
+    int width = 0, height = 0;
+    for (int i = 0; i < sampler->getMipLevels(); i++) {
+        int levelWidth, levelHeight;
+        const unsigned char *texels = sampler->getLevelTexels(i, levelWidth, levelHeight);
+        blocks.insert(blocks.end(), texels, texels + compressedSize(format, levelWidth, levelHeight));
+        if (i == 0) {
+            width = levelWidth;
+            height = levelHeight;
+        }
+    }
+    if (!saveDds(output, format, width, height, sampler->getMipLevels(), blocks.data(), (int) blocks.size()))
+        return 1;
+    std::cout << input << " " << width << "x" << height << ", " << sampler->getMipLevels() << " levels: "
+              << blocks.size() << " bytes of blocks" << std::endl;
+    return 0;
+}
@@ -55,6 +55,21 @@ Mat44 perspective(float fovy, float aspect, float zNear, float zFar) {
     return mat;
 }
 
+Mat44 perspectiveReversed(float fovy, float aspect, float zNear, float zFar) {
+    float rFovy = fovy * PI / 180;
+    float tanHalfFovy = tanf(rFovy / 2);
+
+    Mat44 mat;
+    mat.LoadIdentity();
+    mat.entries[0] = 1 / (aspect * tanHalfFovy);
+    mat.entries[5] = 1 / tanHalfFovy;
+    mat.entries[10] = zNear / (zFar - zNear);
+    mat.entries[11] = -1;
+    mat.entries[14] = zFar * zNear / (zFar - zNear);
+    mat.entries[15] = 0;
+    return mat;
+}
+
 Mat44 ortho(float left, float right, float bottom, float top, float n, float f) {
     Mat44 mat;
     mat.LoadIdentity();
@@ -14,6 +14,9 @@ Mat44 lookAt(float eyeX, float eyeY, float eyeZ,
 
 Mat44 perspective(float fovy, float aspect, float zNear, float zFar);
 
+// ndc z 1 at zNear and 0 at zFar, for DEPTH_FLOAT32_REV buffers
+Mat44 perspectiveReversed(float fovy, float aspect, float zNear, float zFar);
+
 Mat44 ortho(float left, float right, float bottom, float top, float n, float f);
 
 int project(float objX, float objY, float objZ,